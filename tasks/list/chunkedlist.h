@@ -0,0 +1,588 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+// Unrolled list: every node keeps up to `capacity` elements in the slots
+// [lo, hi) of a small array. Insertion and erasure at either end of a node
+// and push/pop at the ends of the list never move elements, so the other
+// iterators stay valid. Anything else shifts elements inside one node (and
+// may split it or absorb its successor), which invalidates iterators into
+// the affected nodes.
+template <typename T, typename Alloc = std::allocator<T>>
+class ChunkedList {
+ private:
+  static const size_t chunk_bytes = 512;
+  static const size_t capacity =
+      sizeof(T) < chunk_bytes ? chunk_bytes / sizeof(T) : 1;
+
+  struct BaseChunk {
+    BaseChunk* prev;
+    BaseChunk* next;
+    size_t lo = 0;
+    size_t hi = 0;
+  };
+
+  struct Chunk : BaseChunk {
+    alignas(T) char data[capacity * sizeof(T)];
+  };
+
+  using ChunkAlloc =
+      typename std::allocator_traits<Alloc>::template rebind_alloc<Chunk>;
+  using ChunkTraits = std::allocator_traits<ChunkAlloc>;
+
+  BaseChunk fake_{&fake_, &fake_};
+  size_t size_ = 0;
+  [[no_unique_address]] ChunkAlloc alloc_;
+
+  static T* slot(BaseChunk* chunk, size_t index) {
+    return reinterpret_cast<T*>(static_cast<Chunk*>(chunk)->data) + index;
+  }
+
+  BaseChunk* create_chunk(BaseChunk* after);
+  void destroy_chunk(BaseChunk* chunk);
+  // Moves the elements of chunk down so that they start at new_lo < lo.
+  void relocate(BaseChunk* chunk, size_t new_lo);
+  void split(BaseChunk* chunk);
+  // Chunk has a free slot and lo <= index <= hi; returns the new position.
+  size_t insert_at(BaseChunk* chunk, size_t index, T&& value);
+  void merge_next(BaseChunk* chunk);
+
+  void steal(ChunkedList& another);
+  void swap_chunks(ChunkedList& another);
+
+ public:
+  using value_type = T;
+  using allocator_type = Alloc;
+  using size_type = size_t;
+  using difference_type = std::ptrdiff_t;
+  using reference = T&;
+  using const_reference = const T&;
+
+  template <bool is_const>
+  class common_iterator {
+   private:
+    BaseChunk* chunk_ = nullptr;
+    size_t index_ = 0;
+
+    friend class ChunkedList;
+
+   public:
+    using pointer = typename std::conditional<is_const, const T*, T*>::type;
+    using reference = typename std::conditional<is_const, const T&, T&>::type;
+    using value_type = T;
+    using iterator_category = std::bidirectional_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+
+    common_iterator() = default;
+    common_iterator(BaseChunk* chunk, size_t index)
+        : chunk_(chunk),
+          index_(index) {
+    }
+
+    common_iterator& operator++() {
+      if (++index_ == chunk_->hi) {
+        chunk_ = chunk_->next;
+        index_ = chunk_->lo;
+      }
+      return *this;
+    }
+    common_iterator operator++(int) {
+      common_iterator copy = *this;
+      ++*this;
+      return copy;
+    }
+    common_iterator& operator--() {
+      if (index_ == chunk_->lo) {
+        chunk_ = chunk_->prev;
+        index_ = chunk_->hi;
+      }
+      --index_;
+      return *this;
+    }
+    common_iterator operator--(int) {
+      common_iterator copy = *this;
+      --*this;
+      return copy;
+    }
+
+    bool operator==(const common_iterator& another) const {
+      return chunk_ == another.chunk_ && index_ == another.index_;
+    }
+    bool operator!=(const common_iterator& another) const {
+      return !(*this == another);
+    }
+
+    reference operator*() const {
+      return *slot(chunk_, index_);
+    }
+    pointer operator->() const {
+      return slot(chunk_, index_);
+    }
+
+    operator common_iterator<true>() const {
+      return common_iterator<true>(chunk_, index_);
+    }
+  };
+
+  typedef common_iterator<false> iterator;
+  typedef common_iterator<true> const_iterator;
+  typedef std::reverse_iterator<iterator> reverse_iterator;
+  typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+  ChunkedList() = default;
+  ChunkedList(const Alloc& alloc);
+  ChunkedList(size_t count, const Alloc& alloc = Alloc());
+  ChunkedList(size_t count, const T& value, const Alloc& alloc = Alloc());
+  ChunkedList(const ChunkedList& another);
+  ChunkedList(ChunkedList&& another) noexcept;
+  ChunkedList& operator=(const ChunkedList& another);
+  ChunkedList& operator=(ChunkedList&& another);
+  ~ChunkedList() {
+    clear();
+  }
+
+  Alloc get_allocator() const {
+    return Alloc(alloc_);
+  }
+
+  size_t size() const {
+    return size_;
+  }
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  T& front() {
+    return *begin();
+  }
+  const T& front() const {
+    return *begin();
+  }
+  T& back() {
+    return *rbegin();
+  }
+  const T& back() const {
+    return *rbegin();
+  }
+
+  iterator begin() {
+    return iterator(fake_.next, fake_.next->lo);
+  }
+  const_iterator begin() const {
+    return const_iterator(fake_.next, fake_.next->lo);
+  }
+  iterator end() {
+    return iterator(&fake_, 0);
+  }
+  const_iterator end() const {
+    return const_iterator(const_cast<BaseChunk*>(&fake_), 0);
+  }
+  const_iterator cbegin() const {
+    return begin();
+  }
+  const_iterator cend() const {
+    return end();
+  }
+
+  reverse_iterator rbegin() {
+    return reverse_iterator(end());
+  }
+  const_reverse_iterator rbegin() const {
+    return const_reverse_iterator(end());
+  }
+  reverse_iterator rend() {
+    return reverse_iterator(begin());
+  }
+  const_reverse_iterator rend() const {
+    return const_reverse_iterator(begin());
+  }
+  const_reverse_iterator crbegin() const {
+    return const_reverse_iterator(cend());
+  }
+  const_reverse_iterator crend() const {
+    return const_reverse_iterator(cbegin());
+  }
+
+  template <typename... Args>
+  iterator emplace(const_iterator pos, Args&&... args);
+  iterator insert(const_iterator pos, const T& value) {
+    return emplace(pos, value);
+  }
+  iterator insert(const_iterator pos, T&& value) {
+    return emplace(pos, std::move(value));
+  }
+  iterator erase(const_iterator pos);
+  iterator erase(const_iterator first, const_iterator last);
+
+  void push_back(const T& value) {
+    emplace(end(), value);
+  }
+  void push_back(T&& value) {
+    emplace(end(), std::move(value));
+  }
+  void push_front(const T& value) {
+    emplace(begin(), value);
+  }
+  void push_front(T&& value) {
+    emplace(begin(), std::move(value));
+  }
+  void pop_back() {
+    erase(std::prev(end()));
+  }
+  void pop_front() {
+    erase(begin());
+  }
+
+  void clear();
+  void swap(ChunkedList& another);
+};
+
+template <typename T, typename Alloc>
+typename ChunkedList<T, Alloc>::BaseChunk* ChunkedList<T, Alloc>::create_chunk(
+    BaseChunk* after) {
+  Chunk* chunk = ChunkTraits::allocate(alloc_, 1);
+  new (chunk) Chunk;
+  chunk->prev = after;
+  chunk->next = after->next;
+  after->next->prev = chunk;
+  after->next = chunk;
+  return chunk;
+}
+
+template <typename T, typename Alloc>
+void ChunkedList<T, Alloc>::destroy_chunk(BaseChunk* chunk) {
+  chunk->prev->next = chunk->next;
+  chunk->next->prev = chunk->prev;
+  ChunkTraits::deallocate(alloc_, static_cast<Chunk*>(chunk), 1);
+}
+
+template <typename T, typename Alloc>
+void ChunkedList<T, Alloc>::relocate(BaseChunk* chunk, size_t new_lo) {
+  size_t count = chunk->hi - chunk->lo;
+  for (size_t i = 0; i < count; ++i) {
+    T* from = slot(chunk, chunk->lo + i);
+    T* to = slot(chunk, new_lo + i);
+    if (new_lo + i < chunk->lo) {
+      ChunkTraits::construct(alloc_, to, std::move(*from));
+    } else {
+      *to = std::move(*from);
+    }
+  }
+  for (size_t i = std::max(chunk->lo, new_lo + count); i < chunk->hi; ++i) {
+    ChunkTraits::destroy(alloc_, slot(chunk, i));
+  }
+  chunk->lo = new_lo;
+  chunk->hi = new_lo + count;
+}
+
+template <typename T, typename Alloc>
+void ChunkedList<T, Alloc>::split(BaseChunk* chunk) {
+  BaseChunk* half = create_chunk(chunk);
+  size_t mid = (chunk->lo + chunk->hi) / 2;
+  for (size_t i = mid; i < chunk->hi; ++i) {
+    ChunkTraits::construct(alloc_, slot(half, half->hi),
+                           std::move(*slot(chunk, i)));
+    ++half->hi;
+    ChunkTraits::destroy(alloc_, slot(chunk, i));
+  }
+  chunk->hi = mid;
+}
+
+template <typename T, typename Alloc>
+size_t ChunkedList<T, Alloc>::insert_at(BaseChunk* chunk, size_t index,
+                                        T&& value) {
+  bool can_right = chunk->hi < capacity;
+  bool can_left = chunk->lo > 0;
+  if (can_left && (!can_right || index - chunk->lo < chunk->hi - index)) {
+    ChunkTraits::construct(alloc_, slot(chunk, chunk->lo - 1),
+                           std::move(*slot(chunk, chunk->lo)));
+    for (size_t i = chunk->lo; i + 1 < index; ++i) {
+      *slot(chunk, i) = std::move(*slot(chunk, i + 1));
+    }
+    --chunk->lo;
+    --index;
+  } else {
+    ChunkTraits::construct(alloc_, slot(chunk, chunk->hi),
+                           std::move(*slot(chunk, chunk->hi - 1)));
+    for (size_t i = chunk->hi - 1; i > index; --i) {
+      *slot(chunk, i) = std::move(*slot(chunk, i - 1));
+    }
+    ++chunk->hi;
+  }
+  *slot(chunk, index) = std::move(value);
+  return index;
+}
+
+template <typename T, typename Alloc>
+void ChunkedList<T, Alloc>::merge_next(BaseChunk* chunk) {
+  BaseChunk* next = chunk->next;
+  size_t count = chunk->hi - chunk->lo;
+  size_t next_count = next->hi - next->lo;
+  if (next == &fake_ || count + next_count > capacity / 2) {
+    return;
+  }
+  if (chunk->hi + next_count > capacity) {
+    relocate(chunk, 0);
+  }
+  for (size_t i = next->lo; i < next->hi; ++i) {
+    ChunkTraits::construct(alloc_, slot(chunk, chunk->hi),
+                           std::move(*slot(next, i)));
+    ++chunk->hi;
+    ChunkTraits::destroy(alloc_, slot(next, i));
+  }
+  destroy_chunk(next);
+}
+
+template <typename T, typename Alloc>
+void ChunkedList<T, Alloc>::steal(ChunkedList& another) {
+  if (another.size_ == 0) {
+    return;
+  }
+  fake_.next = another.fake_.next;
+  fake_.prev = another.fake_.prev;
+  fake_.next->prev = &fake_;
+  fake_.prev->next = &fake_;
+  size_ = another.size_;
+  another.fake_.next = another.fake_.prev = &another.fake_;
+  another.size_ = 0;
+}
+
+template <typename T, typename Alloc>
+void ChunkedList<T, Alloc>::swap_chunks(ChunkedList& another) {
+  ChunkedList tmp(alloc_);
+  tmp.steal(*this);
+  steal(another);
+  another.steal(tmp);
+}
+
+template <typename T, typename Alloc>
+ChunkedList<T, Alloc>::ChunkedList(const Alloc& alloc)
+    : alloc_(alloc) {
+}
+
+template <typename T, typename Alloc>
+ChunkedList<T, Alloc>::ChunkedList(size_t count, const Alloc& alloc)
+    : alloc_(alloc) {
+  try {
+    for (size_t i = 0; i < count; ++i) {
+      emplace(end());
+    }
+  } catch (...) {
+    clear();
+    throw;
+  }
+}
+
+template <typename T, typename Alloc>
+ChunkedList<T, Alloc>::ChunkedList(size_t count, const T& value,
+                                   const Alloc& alloc)
+    : alloc_(alloc) {
+  try {
+    for (size_t i = 0; i < count; ++i) {
+      emplace(end(), value);
+    }
+  } catch (...) {
+    clear();
+    throw;
+  }
+}
+
+template <typename T, typename Alloc>
+ChunkedList<T, Alloc>::ChunkedList(const ChunkedList& another)
+    : alloc_(ChunkTraits::select_on_container_copy_construction(
+          another.alloc_)) {
+  try {
+    for (const T& value : another) {
+      emplace(end(), value);
+    }
+  } catch (...) {
+    clear();
+    throw;
+  }
+}
+
+template <typename T, typename Alloc>
+ChunkedList<T, Alloc>::ChunkedList(ChunkedList&& another) noexcept
+    : alloc_(std::move(another.alloc_)) {
+  steal(another);
+}
+
+template <typename T, typename Alloc>
+ChunkedList<T, Alloc>& ChunkedList<T, Alloc>::operator=(
+    const ChunkedList& another) {
+  if (this == &another) {
+    return *this;
+  }
+  ChunkedList copy(ChunkTraits::propagate_on_container_copy_assignment::value
+                       ? another.alloc_
+                       : alloc_);
+  for (const T& value : another) {
+    copy.emplace(copy.end(), value);
+  }
+  swap_chunks(copy);
+  std::swap(alloc_, copy.alloc_);
+  return *this;
+}
+
+template <typename T, typename Alloc>
+ChunkedList<T, Alloc>& ChunkedList<T, Alloc>::operator=(
+    ChunkedList&& another) {
+  if (this == &another) {
+    return *this;
+  }
+  if constexpr (ChunkTraits::propagate_on_container_move_assignment::value) {
+    clear();
+    alloc_ = std::move(another.alloc_);
+    steal(another);
+  } else {
+    if (alloc_ == another.alloc_) {
+      clear();
+      steal(another);
+    } else {
+      ChunkedList copy(alloc_);
+      for (T& value : another) {
+        copy.emplace(copy.end(), std::move(value));
+      }
+      swap_chunks(copy);
+    }
+  }
+  return *this;
+}
+
+template <typename T, typename Alloc>
+template <typename... Args>
+typename ChunkedList<T, Alloc>::iterator ChunkedList<T, Alloc>::emplace(
+    const_iterator pos, Args&&... args) {
+  BaseChunk* chunk = pos.chunk_;
+  size_t index = pos.index_;
+  if (index != chunk->lo) {
+    T value(std::forward<Args>(args)...);
+    if (chunk->lo == 0 && chunk->hi == capacity) {
+      split(chunk);
+      if (index > chunk->hi) {
+        index -= chunk->hi;
+        chunk = chunk->next;
+      }
+    }
+    if (index == chunk->hi) {
+      ChunkTraits::construct(alloc_, slot(chunk, index), std::move(value));
+      ++chunk->hi;
+    } else {
+      index = insert_at(chunk, index, std::move(value));
+    }
+    ++size_;
+    return iterator(chunk, index);
+  }
+  // Inserting in front of a chunk: the tail of the previous one or the head
+  // of this one are free to take the element without moving anything.
+  BaseChunk* prev = chunk->prev;
+  if (prev != &fake_ && prev->hi < capacity) {
+    ChunkTraits::construct(alloc_, slot(prev, prev->hi),
+                           std::forward<Args>(args)...);
+    ++size_;
+    return iterator(prev, prev->hi++);
+  }
+  if (chunk != &fake_ && chunk->lo > 0) {
+    ChunkTraits::construct(alloc_, slot(chunk, chunk->lo - 1),
+                           std::forward<Args>(args)...);
+    ++size_;
+    return iterator(chunk, --chunk->lo);
+  }
+  BaseChunk* fresh = create_chunk(prev);
+  // A list growing to the front fills its first chunk from the top.
+  size_t place = (prev == &fake_ && chunk != &fake_ ? capacity - 1 : 0);
+  try {
+    ChunkTraits::construct(alloc_, slot(fresh, place),
+                           std::forward<Args>(args)...);
+  } catch (...) {
+    destroy_chunk(fresh);
+    throw;
+  }
+  fresh->lo = place;
+  fresh->hi = place + 1;
+  ++size_;
+  return iterator(fresh, place);
+}
+
+template <typename T, typename Alloc>
+typename ChunkedList<T, Alloc>::iterator ChunkedList<T, Alloc>::erase(
+    const_iterator pos) {
+  BaseChunk* chunk = pos.chunk_;
+  size_t index = pos.index_;
+  --size_;
+  if (index == chunk->lo) {
+    ChunkTraits::destroy(alloc_, slot(chunk, index));
+    ++chunk->lo;
+    ++index;
+  } else if (index + 1 == chunk->hi) {
+    ChunkTraits::destroy(alloc_, slot(chunk, index));
+    --chunk->hi;
+    ++index;
+  } else {
+    if (index - chunk->lo < chunk->hi - index) {
+      for (size_t i = index; i > chunk->lo; --i) {
+        *slot(chunk, i) = std::move(*slot(chunk, i - 1));
+      }
+      ChunkTraits::destroy(alloc_, slot(chunk, chunk->lo));
+      ++chunk->lo;
+      ++index;
+    } else {
+      for (size_t i = index; i + 1 < chunk->hi; ++i) {
+        *slot(chunk, i) = std::move(*slot(chunk, i + 1));
+      }
+      --chunk->hi;
+      ChunkTraits::destroy(alloc_, slot(chunk, chunk->hi));
+    }
+    size_t offset = chunk->lo;
+    merge_next(chunk);
+    index -= offset - chunk->lo;
+  }
+  if (index < chunk->hi) {
+    return iterator(chunk, index);
+  }
+  BaseChunk* next = chunk->next;
+  if (chunk->lo == chunk->hi) {
+    destroy_chunk(chunk);
+  }
+  return iterator(next, next->lo);
+}
+
+template <typename T, typename Alloc>
+typename ChunkedList<T, Alloc>::iterator ChunkedList<T, Alloc>::erase(
+    const_iterator first, const_iterator last) {
+  // Erasing may shift elements under last, so count them instead
+  size_t count = std::distance(first, last);
+  iterator it(first.chunk_, first.index_);
+  for (size_t i = 0; i < count; ++i) {
+    it = erase(it);
+  }
+  return it;
+}
+
+template <typename T, typename Alloc>
+void ChunkedList<T, Alloc>::clear() {
+  BaseChunk* chunk = fake_.next;
+  while (chunk != &fake_) {
+    BaseChunk* next = chunk->next;
+    for (size_t i = chunk->lo; i < chunk->hi; ++i) {
+      ChunkTraits::destroy(alloc_, slot(chunk, i));
+    }
+    ChunkTraits::deallocate(alloc_, static_cast<Chunk*>(chunk), 1);
+    chunk = next;
+  }
+  fake_.next = fake_.prev = &fake_;
+  size_ = 0;
+}
+
+template <typename T, typename Alloc>
+void ChunkedList<T, Alloc>::swap(ChunkedList& another) {
+  swap_chunks(another);
+  if constexpr (ChunkTraits::propagate_on_container_swap::value) {
+    std::swap(alloc_, another.alloc_);
+  }
+}
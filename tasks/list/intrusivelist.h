@@ -0,0 +1,306 @@
+#pragma once
+
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+
+// Member that lets an object be linked into an IntrusiveList. An object can
+// sit in as many lists as it has hooks. Copying an object does not copy
+// its memberships.
+class IntrusiveListHook {
+ private:
+  IntrusiveListHook* prev_ = nullptr;
+  IntrusiveListHook* next_ = nullptr;
+
+  template <typename T, IntrusiveListHook T::*Hook>
+  friend class IntrusiveList;
+
+ public:
+  IntrusiveListHook() = default;
+  IntrusiveListHook(const IntrusiveListHook& /*another*/) {
+  }
+  IntrusiveListHook& operator=(const IntrusiveListHook& /*another*/) {
+    return *this;
+  }
+  ~IntrusiveListHook() {
+    // safe mode: an object must leave its lists before it dies
+    assert(!is_linked());
+  }
+
+  bool is_linked() const {
+    return next_ != nullptr;
+  }
+
+  // O(1), the list the hook belongs to does not have to be known.
+  void unlink() {
+    assert(is_linked());
+    prev_->next_ = next_;
+    next_->prev_ = prev_;
+    prev_ = next_ = nullptr;
+  }
+};
+
+// Links objects through their Hook member, so no operation allocates.
+// The list does not own the objects. size() is linear because objects can
+// be unlinked behind the list's back.
+//
+// An object is found from its hook by the hook's offset, which is read
+// from Hook: under the Itanium C++ ABI (GCC, Clang) a pointer to data
+// member holds the offset of the member.
+template <typename T, IntrusiveListHook T::*Hook>
+class IntrusiveList {
+ private:
+  IntrusiveListHook fake_;
+
+  static_assert(sizeof(Hook) == sizeof(std::ptrdiff_t),
+                "pointers to data members are expected to hold offsets");
+
+  static T* owner_of(IntrusiveListHook* hook) {
+    // folds to a constant, Hook is a template argument
+    auto offset = std::bit_cast<std::ptrdiff_t>(Hook);
+    return reinterpret_cast<T*>(reinterpret_cast<char*>(hook) - offset);
+  }
+  static IntrusiveListHook* hook_of(const T& value) {
+    auto* hook = const_cast<IntrusiveListHook*>(&(value.*Hook));
+    // safe mode: the offset read from Hook leads back to the object
+    assert(owner_of(hook) == &value);
+    return hook;
+  }
+
+  static void link_before(IntrusiveListHook* pos, IntrusiveListHook* hook) {
+    // safe mode: linking an object twice through one hook corrupts both lists
+    assert(!hook->is_linked());
+    hook->prev_ = pos->prev_;
+    hook->next_ = pos;
+    pos->prev_->next_ = hook;
+    pos->prev_ = hook;
+  }
+
+  void steal(IntrusiveList& another);
+
+ public:
+  using value_type = T;
+  using size_type = size_t;
+  using difference_type = std::ptrdiff_t;
+  using reference = T&;
+  using const_reference = const T&;
+
+  template <bool is_const>
+  class common_iterator {
+   private:
+    IntrusiveListHook* hook_ = nullptr;
+
+    friend class IntrusiveList;
+
+   public:
+    using pointer = typename std::conditional<is_const, const T*, T*>::type;
+    using reference = typename std::conditional<is_const, const T&, T&>::type;
+    using value_type = T;
+    using iterator_category = std::bidirectional_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+
+    common_iterator() = default;
+    explicit common_iterator(IntrusiveListHook* hook)
+        : hook_(hook) {
+    }
+
+    common_iterator& operator++() {
+      hook_ = hook_->next_;
+      return *this;
+    }
+    common_iterator operator++(int) {
+      common_iterator copy = *this;
+      hook_ = hook_->next_;
+      return copy;
+    }
+    common_iterator& operator--() {
+      hook_ = hook_->prev_;
+      return *this;
+    }
+    common_iterator operator--(int) {
+      common_iterator copy = *this;
+      hook_ = hook_->prev_;
+      return copy;
+    }
+
+    bool operator==(const common_iterator& another) const {
+      return hook_ == another.hook_;
+    }
+    bool operator!=(const common_iterator& another) const {
+      return !(*this == another);
+    }
+
+    reference operator*() const {
+      return *owner_of(hook_);
+    }
+    pointer operator->() const {
+      return owner_of(hook_);
+    }
+
+    operator common_iterator<true>() const {
+      return common_iterator<true>(hook_);
+    }
+  };
+
+  typedef common_iterator<false> iterator;
+  typedef common_iterator<true> const_iterator;
+  typedef std::reverse_iterator<iterator> reverse_iterator;
+  typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+  IntrusiveList() {
+    fake_.prev_ = fake_.next_ = &fake_;
+  }
+  IntrusiveList(const IntrusiveList&) = delete;
+  IntrusiveList& operator=(const IntrusiveList&) = delete;
+  IntrusiveList(IntrusiveList&& another) noexcept;
+  IntrusiveList& operator=(IntrusiveList&& another) noexcept;
+  ~IntrusiveList() {
+    clear();
+    fake_.prev_ = fake_.next_ = nullptr;
+  }
+
+  size_t size() const {
+    return std::distance(begin(), end());
+  }
+  bool empty() const {
+    return fake_.next_ == &fake_;
+  }
+
+  T& front() {
+    return *begin();
+  }
+  const T& front() const {
+    return *begin();
+  }
+  T& back() {
+    return *rbegin();
+  }
+  const T& back() const {
+    return *rbegin();
+  }
+
+  iterator begin() {
+    return iterator(fake_.next_);
+  }
+  const_iterator begin() const {
+    return const_iterator(fake_.next_);
+  }
+  iterator end() {
+    return iterator(&fake_);
+  }
+  const_iterator end() const {
+    return const_iterator(const_cast<IntrusiveListHook*>(&fake_));
+  }
+  const_iterator cbegin() const {
+    return begin();
+  }
+  const_iterator cend() const {
+    return end();
+  }
+
+  reverse_iterator rbegin() {
+    return reverse_iterator(end());
+  }
+  const_reverse_iterator rbegin() const {
+    return const_reverse_iterator(end());
+  }
+  reverse_iterator rend() {
+    return reverse_iterator(begin());
+  }
+  const_reverse_iterator rend() const {
+    return const_reverse_iterator(begin());
+  }
+  const_reverse_iterator crbegin() const {
+    return const_reverse_iterator(cend());
+  }
+  const_reverse_iterator crend() const {
+    return const_reverse_iterator(cbegin());
+  }
+
+  // The value must be linked into this list.
+  iterator iterator_to(T& value) {
+    return iterator(hook_of(value));
+  }
+  const_iterator iterator_to(const T& value) const {
+    return const_iterator(hook_of(value));
+  }
+
+  iterator insert(const_iterator pos, T& value) {
+    link_before(pos.hook_, hook_of(value));
+    return iterator(hook_of(value));
+  }
+  // Unlinks the object, it stays alive.
+  iterator erase(const_iterator pos) {
+    IntrusiveListHook* next = pos.hook_->next_;
+    pos.hook_->unlink();
+    return iterator(next);
+  }
+
+  void push_back(T& value) {
+    insert(end(), value);
+  }
+  void push_front(T& value) {
+    insert(begin(), value);
+  }
+  void pop_back() {
+    // safe mode: the sentinel must never be unlinked
+    assert(!empty());
+    fake_.prev_->unlink();
+  }
+  void pop_front() {
+    assert(!empty());
+    fake_.next_->unlink();
+  }
+
+  void clear();
+  void swap(IntrusiveList& another);
+};
+
+template <typename T, IntrusiveListHook T::*Hook>
+void IntrusiveList<T, Hook>::steal(IntrusiveList& another) {
+  if (another.empty()) {
+    return;
+  }
+  fake_.next_ = another.fake_.next_;
+  fake_.prev_ = another.fake_.prev_;
+  fake_.next_->prev_ = &fake_;
+  fake_.prev_->next_ = &fake_;
+  another.fake_.next_ = another.fake_.prev_ = &another.fake_;
+}
+
+template <typename T, IntrusiveListHook T::*Hook>
+IntrusiveList<T, Hook>::IntrusiveList(IntrusiveList&& another) noexcept
+    : IntrusiveList() {
+  steal(another);
+}
+
+template <typename T, IntrusiveListHook T::*Hook>
+IntrusiveList<T, Hook>& IntrusiveList<T, Hook>::operator=(
+    IntrusiveList&& another) noexcept {
+  if (this != &another) {
+    clear();
+    steal(another);
+  }
+  return *this;
+}
+
+template <typename T, IntrusiveListHook T::*Hook>
+void IntrusiveList<T, Hook>::clear() {
+  IntrusiveListHook* hook = fake_.next_;
+  while (hook != &fake_) {
+    IntrusiveListHook* next = hook->next_;
+    hook->prev_ = hook->next_ = nullptr;
+    hook = next;
+  }
+  fake_.prev_ = fake_.next_ = &fake_;
+}
+
+template <typename T, IntrusiveListHook T::*Hook>
+void IntrusiveList<T, Hook>::swap(IntrusiveList& another) {
+  IntrusiveList tmp;
+  tmp.steal(*this);
+  steal(another);
+  another.steal(tmp);
+}
@@ -0,0 +1,434 @@
+// Timing harness for the list containers and allocators. Correctness lives
+// in stackallocator_test.cpp; this binary only measures.
+//
+//   list_bench [--warmup N] [--repetitions M] [--elements K]
+//              [--push-front FRACTION] [--insert-at FRACTION]
+//              [--sizes S1,S2,...] [--filter SUBSTRING] [--json PATH]
+//
+// Every workload runs on std::list, List and ChunkedList with
+// std::allocator and StackAllocator, for each element size in --sizes
+// (8, 16, 64 or 256 bytes). push_mix sends the --push-front share of its
+// K pushes to the front and the rest to the back; middle_insert inserts K
+// elements before the one at --insert-at of a list of K elements. With
+// StackAllocator a run has to fit a 512 MB arena. A table goes to stderr,
+// JSON to stdout or PATH. Allocation counts are medians over the measured
+// repetitions.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "chunkedlist.h"
+#include "stackallocator.h"
+
+namespace {
+
+size_t heap_allocations = 0;
+
+}  // namespace
+
+void* operator new(size_t bytes) {
+  ++heap_allocations;
+  void* ptr = std::malloc(bytes == 0 ? 1 : bytes);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t /*bytes*/) noexcept {
+  std::free(ptr);
+}
+
+namespace {
+
+const size_t arena_size = 512'000'000;
+
+using Arena = StackStorage<arena_size, StackStats>;
+
+template <typename T>
+using ArenaAllocator = StackAllocator<T, arena_size, StackStats>;
+
+struct Options {
+  int warmup = 1;
+  int repetitions = 5;
+  size_t elements = 1'000'000;
+  double push_front = 0.5;
+  double insert_at = 0.5;
+  std::vector<size_t> sizes = {8, 64};
+  std::string filter;
+  std::string json;
+};
+
+template <size_t Size>
+struct Payload {
+  std::array<char, Size> bytes;
+
+  Payload(size_t seed) {
+    bytes.fill(static_cast<char>(seed));
+  }
+  size_t key() const {
+    return static_cast<unsigned char>(bytes[0]);
+  }
+};
+
+// A workload prepares a container outside the timed region and returns
+// the position to start from, then runs on it. run returns a checksum so
+// that the work cannot be optimized out.
+struct PushMix {
+  static constexpr const char* name = "push_mix";
+
+  template <typename Container>
+  static auto prepare(Container& container, const Options& /*options*/) {
+    return container.end();
+  }
+  // Pushes to the front whenever the running count of front pushes falls
+  // behind the requested share, so the mix is exact and repeatable.
+  template <typename Container>
+  static size_t run(Container& container,
+                    typename Container::iterator /*start*/,
+                    const Options& options) {
+    size_t fronts = 0;
+    for (size_t i = 0; i < options.elements; ++i) {
+      auto due = static_cast<size_t>(static_cast<double>(i + 1) *
+                                     options.push_front);
+      if (fronts < due) {
+        container.push_front(i);
+        ++fronts;
+      } else {
+        container.push_back(i);
+      }
+    }
+    return container.size();
+  }
+};
+
+struct MiddleInsert {
+  static constexpr const char* name = "middle_insert";
+
+  template <typename Container>
+  static auto prepare(Container& container, const Options& options) {
+    for (size_t i = 0; i < options.elements; ++i) {
+      container.push_back(i);
+    }
+    auto offset = static_cast<size_t>(
+        options.insert_at * static_cast<double>(options.elements));
+    return std::next(container.begin(),
+                     static_cast<std::ptrdiff_t>(offset));
+  }
+  template <typename Container>
+  static size_t run(Container& container, typename Container::iterator start,
+                    const Options& options) {
+    for (size_t i = 0; i < options.elements; ++i) {
+      start = container.insert(start, i);
+    }
+    return container.size();
+  }
+};
+
+struct Erase {
+  static constexpr const char* name = "erase";
+
+  template <typename Container>
+  static auto prepare(Container& container, const Options& options) {
+    for (size_t i = 0; i < options.elements; ++i) {
+      container.push_back(i);
+    }
+    return container.begin();
+  }
+  template <typename Container>
+  static size_t run(Container& container, typename Container::iterator start,
+                    const Options& /*options*/) {
+    size_t sum = 0;
+    for (auto it = start; it != container.end();) {
+      sum += it->key();
+      it = container.erase(it);
+      if (it != container.end()) {
+        ++it;
+      }
+    }
+    while (!container.empty()) {
+      container.pop_front();
+    }
+    return sum;
+  }
+};
+
+struct Iterate {
+  static constexpr const char* name = "iterate";
+  static const int scans = 10;
+
+  template <typename Container>
+  static auto prepare(Container& container, const Options& options) {
+    for (size_t i = 0; i < options.elements; ++i) {
+      container.push_back(i);
+    }
+    return container.begin();
+  }
+  template <typename Container>
+  static size_t run(Container& container,
+                    typename Container::iterator /*start*/,
+                    const Options& /*options*/) {
+    size_t sum = 0;
+    for (int i = 0; i < scans; ++i) {
+      for (const auto& value : container) {
+        sum += value.key();
+      }
+    }
+    return sum;
+  }
+};
+
+struct Sample {
+  double micros;
+  size_t heap_allocations;
+  size_t arena_allocations;
+};
+
+struct Result {
+  std::string container;
+  std::string allocator;
+  std::string workload;
+  size_t element_size;
+  std::vector<Sample> samples;
+
+  // Nearest-rank percentile of the measured times.
+  double percentile(double fraction) const;
+  // Median of an allocation counter over the measured runs.
+  size_t median(size_t Sample::*counter) const;
+};
+
+double Result::percentile(double fraction) const {
+  std::vector<double> times;
+  times.reserve(samples.size());
+  for (const auto& sample : samples) {
+    times.push_back(sample.micros);
+  }
+  if (times.empty()) {
+    return 0;
+  }
+  std::sort(times.begin(), times.end());
+  auto rank =
+      static_cast<size_t>(fraction * static_cast<double>(times.size()));
+  return times[std::min(rank, times.size() - 1)];
+}
+
+size_t Result::median(size_t Sample::*counter) const {
+  std::vector<size_t> counts;
+  counts.reserve(samples.size());
+  for (const auto& sample : samples) {
+    counts.push_back(sample.*counter);
+  }
+  if (counts.empty()) {
+    return 0;
+  }
+  std::sort(counts.begin(), counts.end());
+  return counts[counts.size() / 2];
+}
+
+size_t volatile sink = 0;
+
+template <typename Workload, typename Container, typename MakeContainer>
+Sample measure_once(const MakeContainer& make, const Options& options,
+                    const Arena* arena) {
+  Container container = make();
+  auto start_at = Workload::prepare(container, options);
+  size_t heap_before = heap_allocations;
+  size_t arena_before = (arena == nullptr ? 0 : arena->stats().allocations);
+
+  auto start = std::chrono::steady_clock::now();
+  sink = sink + Workload::run(container, start_at, options);
+  auto finish = std::chrono::steady_clock::now();
+
+  return {std::chrono::duration<double, std::micro>(finish - start).count(),
+          heap_allocations - heap_before,
+          (arena == nullptr ? 0 : arena->stats().allocations) - arena_before};
+}
+
+template <template <typename, typename> class Container, typename T,
+          typename Workload>
+void measure(const std::string& container_name, const Options& options,
+             std::vector<Result>& results) {
+  std::string workload_name = Workload::name;
+  std::string tag = container_name + "/" + workload_name + "/" +
+                    std::to_string(sizeof(T));
+  if (tag.find(options.filter) == std::string::npos) {
+    return;
+  }
+
+  Result with_std{container_name, "std::allocator", workload_name, sizeof(T),
+                  {}};
+  Result with_stack{container_name, "StackAllocator", workload_name,
+                    sizeof(T), {}};
+  for (int i = 0; i < options.warmup + options.repetitions; ++i) {
+    Sample heap = measure_once<Workload, Container<T, std::allocator<T>>>(
+        [] { return Container<T, std::allocator<T>>(); }, options, nullptr);
+
+    // default-initialized, so that the arena is not zeroed every time
+    std::unique_ptr<Arena> arena(new Arena);
+    Sample stack = measure_once<Workload, Container<T, ArenaAllocator<T>>>(
+        [&arena] {
+          return Container<T, ArenaAllocator<T>>(ArenaAllocator<T>(*arena));
+        },
+        options, arena.get());
+
+    if (i >= options.warmup) {
+      with_std.samples.push_back(heap);
+      with_stack.samples.push_back(stack);
+    }
+  }
+
+  for (const auto* result : {&with_std, &with_stack}) {
+    std::cerr << "  " << result->container << " / " << result->allocator
+              << " / " << result->workload << " / " << result->element_size
+              << " B: min " << result->percentile(0.0) / 1000 << " ms, median "
+              << result->percentile(0.5) / 1000 << " ms, p99 "
+              << result->percentile(0.99) / 1000 << " ms, allocations "
+              << result->median(&Sample::heap_allocations) +
+                     result->median(&Sample::arena_allocations)
+              << std::endl;
+  }
+  results.push_back(std::move(with_std));
+  results.push_back(std::move(with_stack));
+}
+
+template <template <typename, typename> class Container, typename T>
+void measure_all(const std::string& container_name, const Options& options,
+                 std::vector<Result>& results) {
+  measure<Container, T, PushMix>(container_name, options, results);
+  measure<Container, T, MiddleInsert>(container_name, options, results);
+  measure<Container, T, Erase>(container_name, options, results);
+  measure<Container, T, Iterate>(container_name, options, results);
+}
+
+template <typename T, typename Alloc>
+using StdList = std::list<T, Alloc>;
+
+// Element sizes that --sizes can pick.
+constexpr std::array<size_t, 4> payload_sizes = {8, 16, 64, 256};
+
+template <size_t Size>
+void measure_size(const Options& options, std::vector<Result>& results) {
+  if (std::find(options.sizes.begin(), options.sizes.end(), Size) ==
+      options.sizes.end()) {
+    return;
+  }
+  measure_all<StdList, Payload<Size>>("std::list", options, results);
+  measure_all<List, Payload<Size>>("List", options, results);
+  measure_all<ChunkedList, Payload<Size>>("ChunkedList", options, results);
+}
+
+void write_json(std::ostream& out, const Options& options,
+                const std::vector<Result>& results) {
+  out << "{\n  \"elements\": " << options.elements
+      << ",\n  \"warmup\": " << options.warmup
+      << ",\n  \"repetitions\": " << options.repetitions
+      << ",\n  \"push_front\": " << options.push_front
+      << ",\n  \"insert_at\": " << options.insert_at
+      << ",\n  \"results\": [";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result& result = results[i];
+    out << (i == 0 ? "\n" : ",\n") << "    {\"container\": \""
+        << result.container << "\", \"allocator\": \"" << result.allocator
+        << "\", \"workload\": \"" << result.workload
+        << "\", \"element_size\": " << result.element_size
+        << ", \"min_us\": " << result.percentile(0.0)
+        << ", \"median_us\": " << result.percentile(0.5)
+        << ", \"p99_us\": " << result.percentile(0.99)
+        << ", \"heap_allocations\": "
+        << result.median(&Sample::heap_allocations)
+        << ", \"arena_allocations\": "
+        << result.median(&Sample::arena_allocations) << "}";
+  }
+  out << "\n  ]\n}\n";
+}
+
+std::vector<size_t> parse_sizes(const std::string& value) {
+  std::vector<size_t> sizes;
+  size_t begin = 0;
+  while (begin <= value.size()) {
+    size_t end = std::min(value.find(',', begin), value.size());
+    size_t size = std::stoul(value.substr(begin, end - begin));
+    if (std::find(payload_sizes.begin(), payload_sizes.end(), size) ==
+        payload_sizes.end()) {
+      throw std::invalid_argument("unsupported element size " +
+                                  std::to_string(size));
+    }
+    sizes.push_back(size);
+    begin = end + 1;
+  }
+  return sizes;
+}
+
+double parse_fraction(const std::string& key, const std::string& value) {
+  double fraction = std::stod(value);
+  if (fraction < 0 || fraction > 1) {
+    throw std::invalid_argument("option " + key +
+                                " expects a fraction in [0, 1]");
+  }
+  return fraction;
+}
+
+Options parse_options(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; i += 2) {
+    std::string key = argv[i];
+    if (i + 1 == argc) {
+      throw std::invalid_argument("option " + key + " expects a value");
+    }
+    std::string value = argv[i + 1];
+    if (key == "--warmup") {
+      options.warmup = std::stoi(value);
+    } else if (key == "--repetitions") {
+      options.repetitions = std::max(1, std::stoi(value));
+    } else if (key == "--elements") {
+      options.elements = std::stoul(value);
+    } else if (key == "--push-front") {
+      options.push_front = parse_fraction(key, value);
+    } else if (key == "--insert-at") {
+      options.insert_at = parse_fraction(key, value);
+    } else if (key == "--sizes") {
+      options.sizes = parse_sizes(value);
+    } else if (key == "--filter") {
+      options.filter = value;
+    } else if (key == "--json") {
+      options.json = value;
+    } else {
+      throw std::invalid_argument("unknown option " + key);
+    }
+  }
+  return options;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options = parse_options(argc, argv);
+
+  std::vector<Result> results;
+  measure_size<payload_sizes[0]>(options, results);
+  measure_size<payload_sizes[1]>(options, results);
+  measure_size<payload_sizes[2]>(options, results);
+  measure_size<payload_sizes[3]>(options, results);
+
+  if (options.json.empty()) {
+    write_json(std::cout, options, results);
+  } else {
+    std::ofstream out(options.json);
+    write_json(out, options, results);
+  }
+}
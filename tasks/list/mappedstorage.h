@@ -0,0 +1,367 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+// Pointer that stores the distance from itself to the pointee, so a
+// structure built out of them stays valid wherever its memory is mapped.
+// As in other offset pointer implementations, distance 1 encodes nullptr.
+template <typename T>
+class OffsetPtr {
+ private:
+  std::ptrdiff_t offset_ = 1;
+
+  template <typename U>
+  friend class OffsetPtr;
+
+  // Goes through integers: pointer arithmetic from this would let the
+  // optimizer assume the result stays inside the object holding the pointer.
+  void set(const volatile void* ptr) {
+    offset_ = (ptr == nullptr ? 1
+                              : static_cast<std::ptrdiff_t>(
+                                    reinterpret_cast<uintptr_t>(ptr) -
+                                    reinterpret_cast<uintptr_t>(this)));
+  }
+
+ public:
+  using element_type = T;
+  using difference_type = std::ptrdiff_t;
+  using value_type = std::remove_cv_t<T>;
+  using pointer = OffsetPtr;
+  using reference = std::add_lvalue_reference_t<T>;
+  using iterator_category = std::random_access_iterator_tag;
+
+  template <typename U>
+  using rebind = OffsetPtr<U>;
+
+  OffsetPtr() = default;
+  OffsetPtr(std::nullptr_t) {
+  }
+  OffsetPtr(T* ptr) {
+    set(ptr);
+  }
+  OffsetPtr(const OffsetPtr& another) {
+    set(another.get());
+  }
+  // As with raw pointers, only a cast turns a void pointer into a typed one.
+  template <typename U>
+    requires std::is_convertible_v<U*, T*> || std::is_void_v<U>
+  explicit(!std::is_convertible_v<U*, T*>)
+      OffsetPtr(const OffsetPtr<U>& another) {
+    set(static_cast<T*>(another.get()));
+  }
+
+  OffsetPtr& operator=(const OffsetPtr& another) {
+    set(another.get());
+    return *this;
+  }
+  OffsetPtr& operator=(T* ptr) {
+    set(ptr);
+    return *this;
+  }
+
+  T* get() const {
+    if (offset_ == 1) {
+      return nullptr;
+    }
+    return reinterpret_cast<T*>(reinterpret_cast<uintptr_t>(this) + offset_);
+  }
+
+  reference operator*() const {
+    return *get();
+  }
+  T* operator->() const {
+    return get();
+  }
+  template <typename U = T>
+  std::add_lvalue_reference_t<U> operator[](std::ptrdiff_t index) const {
+    return get()[index];
+  }
+  explicit operator bool() const {
+    return offset_ != 1;
+  }
+
+  template <typename U = T>
+  static OffsetPtr pointer_to(U& value) {
+    return OffsetPtr(std::addressof(value));
+  }
+
+  OffsetPtr& operator+=(std::ptrdiff_t delta) {
+    set(get() + delta);
+    return *this;
+  }
+  OffsetPtr& operator-=(std::ptrdiff_t delta) {
+    set(get() - delta);
+    return *this;
+  }
+  OffsetPtr& operator++() {
+    return *this += 1;
+  }
+  OffsetPtr operator++(int) {
+    OffsetPtr copy = *this;
+    *this += 1;
+    return copy;
+  }
+  OffsetPtr& operator--() {
+    return *this -= 1;
+  }
+  OffsetPtr operator--(int) {
+    OffsetPtr copy = *this;
+    *this -= 1;
+    return copy;
+  }
+  friend OffsetPtr operator+(const OffsetPtr& ptr, std::ptrdiff_t delta) {
+    return OffsetPtr(ptr.get() + delta);
+  }
+  friend OffsetPtr operator-(const OffsetPtr& ptr, std::ptrdiff_t delta) {
+    return OffsetPtr(ptr.get() - delta);
+  }
+  friend std::ptrdiff_t operator-(const OffsetPtr& lhs, const OffsetPtr& rhs) {
+    return lhs.get() - rhs.get();
+  }
+
+  friend bool operator==(const OffsetPtr& lhs, const OffsetPtr& rhs) {
+    return lhs.get() == rhs.get();
+  }
+  friend bool operator!=(const OffsetPtr& lhs, const OffsetPtr& rhs) {
+    return !(lhs == rhs);
+  }
+  friend bool operator<(const OffsetPtr& lhs, const OffsetPtr& rhs) {
+    return lhs.get() < rhs.get();
+  }
+  friend bool operator==(const OffsetPtr& ptr, std::nullptr_t) {
+    return !ptr;
+  }
+  friend bool operator!=(const OffsetPtr& ptr, std::nullptr_t) {
+    return static_cast<bool>(ptr);
+  }
+};
+
+// Bump allocator state kept at the start of the mapping, so that
+// allocators stored inside the file can find it after a remap.
+struct MappedArena {
+  static const uint64_t magic_value = 0x4d495054'4c495354;  // "MIPTLIST"
+
+  uint64_t magic;
+  size_t size;
+  size_t shift;
+  size_t root_size;
+  OffsetPtr<void> root;
+
+  void* allocate(size_t bytes, size_t alignment);
+  void deallocate(void* ptr, size_t bytes);
+};
+
+inline void* MappedArena::allocate(size_t bytes, size_t alignment) {
+  char* begin = reinterpret_cast<char*>(this);
+  void* ptr = begin + shift;
+  size_t space = size - shift;
+  if (std::align(alignment, bytes, ptr, space) == nullptr) {
+    throw std::bad_alloc();
+  }
+  shift = size - space + bytes;
+  return ptr;
+}
+
+inline void MappedArena::deallocate(void* ptr, size_t bytes) {
+  char* block = static_cast<char*>(ptr);
+  if (block + bytes == reinterpret_cast<char*>(this) + shift) {
+    shift = block - reinterpret_cast<char*>(this);
+  }
+}
+
+// StackStorage over a shared file mapping. Objects built in it with
+// MappedStackAllocator (a List, for example) survive the process and are
+// usable as soon as the file is mapped again, at any address. Nothing in
+// the file is destroyed when the storage closes.
+class MappedStackStorage {
+ private:
+  MappedArena* arena_ = nullptr;
+  int fd_ = -1;
+  bool created_ = false;
+
+  [[noreturn]] static void fail(const char* what) {
+    throw std::system_error(errno, std::generic_category(), what);
+  }
+  void close();
+
+ public:
+  // Maps an existing file or creates one of the given size.
+  MappedStackStorage(const std::string& path, size_t size);
+  MappedStackStorage(const MappedStackStorage&) = delete;
+  MappedStackStorage& operator=(const MappedStackStorage&) = delete;
+  ~MappedStackStorage() {
+    close();
+  }
+
+  // True if the file was created rather than mapped again.
+  bool created() const {
+    return created_;
+  }
+  MappedArena& arena() {
+    return *arena_;
+  }
+  size_t used() const {
+    return arena_->shift;
+  }
+
+  void* allocate(size_t bytes, size_t alignment) {
+    return arena_->allocate(bytes, alignment);
+  }
+  void deallocate(void* ptr, size_t bytes) {
+    arena_->deallocate(ptr, bytes);
+  }
+
+  // The object the file is opened for: constructed from args on creation,
+  // found again on every later mapping. T must stay the same type.
+  template <typename T, typename... Args>
+  T& root(Args&&... args);
+
+  void flush();
+};
+
+inline MappedStackStorage::MappedStackStorage(const std::string& path,
+                                              size_t size) {
+  fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd_ == -1) {
+    fail("open");
+  }
+  struct stat info {};
+  if (::fstat(fd_, &info) == -1) {
+    ::close(fd_);
+    fail("fstat");
+  }
+  created_ = (info.st_size == 0);
+  if (created_) {
+    if (size < sizeof(MappedArena)) {
+      ::close(fd_);
+      errno = EINVAL;
+      fail("MappedStackStorage");
+    }
+    if (::ftruncate(fd_, size) == -1) {
+      ::close(fd_);
+      fail("ftruncate");
+    }
+  } else {
+    size = info.st_size;
+  }
+  void* memory =
+      ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (memory == MAP_FAILED) {
+    ::close(fd_);
+    fail("mmap");
+  }
+  arena_ = static_cast<MappedArena*>(memory);
+  if (created_) {
+    new (arena_) MappedArena{MappedArena::magic_value, size,
+                             sizeof(MappedArena), 0, nullptr};
+  } else if (arena_->magic != MappedArena::magic_value ||
+             arena_->size != size) {
+    close();
+    errno = EINVAL;
+    fail("MappedStackStorage");
+  }
+}
+
+inline void MappedStackStorage::close() {
+  if (arena_ != nullptr) {
+    ::munmap(arena_, arena_->size);
+    arena_ = nullptr;
+  }
+  if (fd_ != -1) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+template <typename T, typename... Args>
+T& MappedStackStorage::root(Args&&... args) {
+  if (arena_->root) {
+    if (arena_->root_size != sizeof(T)) {
+      errno = EINVAL;
+      fail("MappedStackStorage::root");
+    }
+    return *static_cast<T*>(arena_->root.get());
+  }
+  void* memory = allocate(sizeof(T), alignof(T));
+  T* object = new (memory) T(std::forward<Args>(args)...);
+  arena_->root = object;
+  arena_->root_size = sizeof(T);
+  return *object;
+}
+
+inline void MappedStackStorage::flush() {
+  if (::msync(arena_, arena_->size, MS_SYNC) == -1) {
+    fail("msync");
+  }
+}
+
+// Allocator over a MappedStackStorage that hands out offset pointers. It
+// refers to the arena through an offset pointer too, so a copy stored in
+// the mapping keeps working after the file is mapped elsewhere.
+template <typename T>
+class MappedStackAllocator {
+ private:
+  OffsetPtr<MappedArena> arena_;
+
+  template <typename U>
+  friend class MappedStackAllocator;
+
+ public:
+  using value_type = T;
+  using pointer = OffsetPtr<T>;
+  using const_pointer = OffsetPtr<const T>;
+  using void_pointer = OffsetPtr<void>;
+  using const_void_pointer = OffsetPtr<const void>;
+
+  template <typename U>
+  struct rebind {
+    using other = MappedStackAllocator<U>;
+  };
+
+  MappedStackAllocator(MappedStackStorage& storage)
+      : arena_(&storage.arena()) {
+  }
+
+  MappedStackAllocator(const MappedStackAllocator& another)
+      : arena_(another.arena_) {
+  }
+  template <typename U>
+  MappedStackAllocator(const MappedStackAllocator<U>& another)
+      : arena_(another.arena_) {
+  }
+  MappedStackAllocator& operator=(const MappedStackAllocator& another) {
+    arena_ = another.arena_;
+    return *this;
+  }
+
+  pointer allocate(size_t count) {
+    return pointer(
+        static_cast<T*>(arena_->allocate(count * sizeof(T), alignof(T))));
+  }
+  void deallocate(pointer ptr, size_t count) {
+    arena_->deallocate(ptr.get(), count * sizeof(T));
+  }
+
+  template <typename U>
+  bool operator==(const MappedStackAllocator<U>& another) const {
+    return arena_ == another.arena_;
+  }
+  template <typename U>
+  bool operator!=(const MappedStackAllocator<U>& another) const {
+    return !(*this == another);
+  }
+};
@@ -1,3 +1,1067 @@
-#define NO_TEST  // remove when solution is ready
+#pragma once
 
-// your code here
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <optional>
+#include <ostream>
+#include <type_traits>
+#include <utility>
+
+// Statistics policies for StackStorage. NoStackStats compiles to nothing,
+// StackStats collects everything needed to size an arena.
+struct NoStackStats {
+  void on_allocate(size_t /*bytes*/, size_t /*padding*/, size_t /*used*/) {
+  }
+  void on_deallocate(size_t /*bytes*/, bool /*reclaimed*/) {
+  }
+  void on_failure(size_t /*bytes*/) {
+  }
+};
+
+struct StackStats {
+  static const size_t size_classes = 16;
+
+  size_t bytes_in_use = 0;
+  size_t high_water_mark = 0;
+  size_t padding_bytes = 0;
+  size_t allocations = 0;
+  // allocations_by_size[k] counts requests of (2^(k-1), 2^k] bytes, the
+  // last class takes everything larger.
+  size_t allocations_by_size[size_classes] = {};
+  // Deallocations of the topmost block, which give the memory back.
+  size_t reclaimed = 0;
+  size_t failed_allocations = 0;
+
+  static size_t size_class(size_t bytes) {
+    size_t index = 0;
+    while (index + 1 < size_classes && (size_t(1) << index) < bytes) {
+      ++index;
+    }
+    return index;
+  }
+
+  void on_allocate(size_t bytes, size_t padding, size_t used) {
+    bytes_in_use += bytes;
+    high_water_mark = std::max(high_water_mark, used);
+    padding_bytes += padding;
+    ++allocations;
+    ++allocations_by_size[size_class(bytes)];
+  }
+  void on_deallocate(size_t bytes, bool reclaimed_top) {
+    bytes_in_use -= bytes;
+    reclaimed += static_cast<size_t>(reclaimed_top);
+  }
+  void on_failure(size_t /*bytes*/) {
+    ++failed_allocations;
+  }
+};
+
+inline std::ostream& operator<<(std::ostream& out, const StackStats& stats) {
+  out << "in use: " << stats.bytes_in_use
+      << " B, high-water mark: " << stats.high_water_mark
+      << " B, padding: " << stats.padding_bytes
+      << " B, allocations: " << stats.allocations
+      << ", reclaimed: " << stats.reclaimed
+      << ", failed: " << stats.failed_allocations << ", by size:";
+  for (size_t i = 0; i < StackStats::size_classes; ++i) {
+    if (stats.allocations_by_size[i] != 0) {
+      out << (i + 1 == StackStats::size_classes ? " >" : " <=")
+          << (size_t(1) << (i + 1 == StackStats::size_classes ? i - 1 : i))
+          << ": " << stats.allocations_by_size[i];
+    }
+  }
+  return out;
+}
+
+template <size_t N, typename Stats = NoStackStats>
+class StackStorage {
+ private:
+  alignas(std::max_align_t) char storage_[N];
+  size_t shift_ = 0;
+  [[no_unique_address]] Stats stats_;
+
+ public:
+  StackStorage() = default;
+  StackStorage(const StackStorage&) = delete;
+  StackStorage& operator=(const StackStorage&) = delete;
+
+  void* allocate(size_t bytes, size_t alignment);
+  // Memory is given back only when the block is the last one allocated,
+  // everything else stays reserved until the storage dies.
+  void deallocate(void* ptr, size_t bytes);
+
+  size_t used() const {
+    return shift_;
+  }
+  const Stats& stats() const {
+    return stats_;
+  }
+};
+
+template <size_t N, typename Stats>
+void* StackStorage<N, Stats>::allocate(size_t bytes, size_t alignment) {
+  void* ptr = storage_ + shift_;
+  size_t space = N - shift_;
+  if (std::align(alignment, bytes, ptr, space) == nullptr) {
+    stats_.on_failure(bytes);
+    throw std::bad_alloc();
+  }
+  size_t padding = N - shift_ - space;
+  shift_ = N - space + bytes;
+  stats_.on_allocate(bytes, padding, shift_);
+  return ptr;
+}
+
+template <size_t N, typename Stats>
+void StackStorage<N, Stats>::deallocate(void* ptr, size_t bytes) {
+  char* block = static_cast<char*>(ptr);
+  bool top = (block + bytes == storage_ + shift_);
+  if (top) {
+    shift_ = block - storage_;
+  }
+  stats_.on_deallocate(bytes, top);
+}
+
+template <typename T, size_t N, typename Stats = NoStackStats>
+class StackAllocator {
+ private:
+  StackStorage<N, Stats>* storage_;
+
+  template <typename U, size_t M, typename S>
+  friend class StackAllocator;
+
+ public:
+  using value_type = T;
+
+  template <typename U>
+  struct rebind {
+    using other = StackAllocator<U, N, Stats>;
+  };
+
+  StackAllocator(StackStorage<N, Stats>& storage)
+      : storage_(&storage) {
+  }
+
+  template <typename U>
+  StackAllocator(const StackAllocator<U, N, Stats>& another)
+      : storage_(another.storage_) {
+  }
+
+  T* allocate(size_t count) {
+    return static_cast<T*>(storage_->allocate(count * sizeof(T), alignof(T)));
+  }
+  void deallocate(T* ptr, size_t count) {
+    storage_->deallocate(ptr, count * sizeof(T));
+  }
+
+  const Stats& stats() const {
+    return storage_->stats();
+  }
+
+  template <typename U>
+  bool operator==(const StackAllocator<U, N, Stats>& another) const {
+    return storage_ == another.storage_;
+  }
+  template <typename U>
+  bool operator!=(const StackAllocator<U, N, Stats>& another) const {
+    return !(*this == another);
+  }
+};
+
+// A StackAllocator for storages that are thrown away whole: containers
+// leave their trivially destructible nodes to the storage instead of
+// freeing them, so clear and the destructor take O(1). The price is that
+// the topmost block is not reclaimed either, so short-lived containers
+// on a long-lived storage should use a plain StackAllocator.
+template <typename T, size_t N, typename Stats = NoStackStats>
+class StackArenaAllocator : public StackAllocator<T, N, Stats> {
+ public:
+  template <typename U>
+  struct rebind {
+    using other = StackArenaAllocator<U, N, Stats>;
+  };
+
+  static constexpr bool is_arena = true;
+
+  StackArenaAllocator(StackStorage<N, Stats>& storage)
+      : StackAllocator<T, N, Stats>(storage) {
+  }
+
+  template <typename U>
+  StackArenaAllocator(const StackArenaAllocator<U, N, Stats>& another)
+      : StackAllocator<T, N, Stats>(another) {
+  }
+};
+
+// Allocators that opt in to having their nodes dropped with the arena,
+// by declaring is_arena. Elements without a destructor need not be freed
+// one by one.
+template <typename Alloc>
+concept ArenaAllocator = Alloc::is_arena;
+
+template <typename T, typename Alloc = std::allocator<T>>
+class List {
+ private:
+  struct BaseNode;
+
+  // Links are stored as the allocator's pointer type, so a list can live in
+  // a memory-mapped file with offset pointers. The algorithms work on raw
+  // pointers taken from them.
+  using BasePtr = typename std::pointer_traits<typename std::allocator_traits<
+      Alloc>::void_pointer>::template rebind<BaseNode>;
+
+  struct BaseNode {
+    BasePtr prev;
+    BasePtr next;
+  };
+
+  struct Node : BaseNode {
+    T value;
+
+    template <typename... Args>
+    Node(Args&&... args)
+        : value(std::forward<Args>(args)...) {
+    }
+  };
+
+  using NodeAlloc =
+      typename std::allocator_traits<Alloc>::template rebind_alloc<Node>;
+  using NodeTraits = std::allocator_traits<NodeAlloc>;
+  using NodePtr = typename NodeTraits::pointer;
+
+  // clear leaves the nodes to the arena
+  static constexpr bool drops_nodes =
+      ArenaAllocator<Alloc> && std::is_trivially_destructible_v<T>;
+
+  BaseNode fake_{&fake_, &fake_};
+  size_t size_ = 0;
+  [[no_unique_address]] NodeAlloc alloc_;
+
+  static BaseNode* raw(const BasePtr& ptr) {
+    return std::to_address(ptr);
+  }
+
+  static void link_before(BaseNode* pos, BaseNode* node) {
+    node->prev = pos->prev;
+    node->next = pos;
+    raw(pos->prev)->next = node;
+    pos->prev = node;
+  }
+  static void unlink(BaseNode* node) {
+    raw(node->prev)->next = node->next;
+    raw(node->next)->prev = node->prev;
+  }
+  // Moves [first, last) before pos, the nodes may belong to another list.
+  static void transfer(BaseNode* pos, BaseNode* first, BaseNode* last) {
+    if (first == last || pos == last) {
+      return;
+    }
+    BaseNode* tail = raw(last->prev);
+    raw(first->prev)->next = last;
+    last->prev = first->prev;
+    first->prev = pos->prev;
+    tail->next = pos;
+    raw(pos->prev)->next = first;
+    pos->prev = tail;
+  }
+  // Both chains are null-terminated and linked through next only.
+  template <typename Compare>
+  static BaseNode* merge_chains(BaseNode* left, BaseNode* right,
+                                Compare& comp);
+
+  template <typename... Args>
+  Node* create_node(Args&&... args);
+  void destroy_node(BaseNode* node);
+
+  // Points the neighbours of fake_ back at it after the chain was moved.
+  void relink_fake() {
+    if (size_ == 0) {
+      fake_.next = fake_.prev = &fake_;
+    } else {
+      raw(fake_.next)->prev = &fake_;
+      raw(fake_.prev)->next = &fake_;
+    }
+  }
+  void steal(List& another);
+  List relocated(const Alloc& alloc);
+  void swap_nodes(List& another);
+
+ public:
+  using value_type = T;
+  using allocator_type = Alloc;
+  using size_type = size_t;
+  using difference_type = std::ptrdiff_t;
+  using reference = T&;
+  using const_reference = const T&;
+
+  template <bool is_const>
+  class common_iterator {
+   private:
+    BaseNode* node_ = nullptr;
+
+    friend class List;
+
+   public:
+    using pointer = typename std::conditional<is_const, const T*, T*>::type;
+    using reference = typename std::conditional<is_const, const T&, T&>::type;
+    using value_type = T;
+    using iterator_category = std::bidirectional_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+
+    common_iterator() = default;
+    explicit common_iterator(BaseNode* node)
+        : node_(node) {
+    }
+
+    common_iterator& operator++() {
+      node_ = raw(node_->next);
+      return *this;
+    }
+    common_iterator operator++(int) {
+      common_iterator copy = *this;
+      node_ = raw(node_->next);
+      return copy;
+    }
+    common_iterator& operator--() {
+      node_ = raw(node_->prev);
+      return *this;
+    }
+    common_iterator operator--(int) {
+      common_iterator copy = *this;
+      node_ = raw(node_->prev);
+      return copy;
+    }
+
+    bool operator==(const common_iterator& another) const {
+      return node_ == another.node_;
+    }
+    bool operator!=(const common_iterator& another) const {
+      return !(*this == another);
+    }
+
+    reference operator*() const {
+      return static_cast<Node*>(node_)->value;
+    }
+    pointer operator->() const {
+      return &static_cast<Node*>(node_)->value;
+    }
+
+    operator common_iterator<true>() const {
+      return common_iterator<true>(node_);
+    }
+  };
+
+  typedef common_iterator<false> iterator;
+  typedef common_iterator<true> const_iterator;
+  typedef std::reverse_iterator<iterator> reverse_iterator;
+  typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+  // Owns a node taken out of a list by extract, together with the
+  // allocator that frees it unless insert links it into a list again.
+  class node_type {
+   private:
+    Node* node_ = nullptr;
+    std::optional<NodeAlloc> alloc_;
+
+    friend class List;
+
+    node_type(Node* node, const NodeAlloc& alloc)
+        : node_(node),
+          alloc_(alloc) {
+    }
+
+    void reset() {
+      if (node_ != nullptr) {
+        NodePtr ptr = std::pointer_traits<NodePtr>::pointer_to(*node_);
+        NodeTraits::destroy(*alloc_, node_);
+        NodeTraits::deallocate(*alloc_, ptr, 1);
+        node_ = nullptr;
+      }
+      alloc_.reset();
+    }
+
+   public:
+    node_type() = default;
+    node_type(node_type&& another) noexcept
+        : node_(std::exchange(another.node_, nullptr)),
+          alloc_(std::move(another.alloc_)) {
+      another.alloc_.reset();
+    }
+    node_type& operator=(node_type&& another) noexcept {
+      if (this != &another) {
+        reset();
+        node_ = std::exchange(another.node_, nullptr);
+        alloc_ = std::move(another.alloc_);
+        another.alloc_.reset();
+      }
+      return *this;
+    }
+    ~node_type() {
+      reset();
+    }
+
+    bool empty() const {
+      return node_ == nullptr;
+    }
+    explicit operator bool() const {
+      return !empty();
+    }
+    Alloc get_allocator() const {
+      return Alloc(*alloc_);
+    }
+    T& value() const {
+      return node_->value;
+    }
+  };
+
+  List() = default;
+  List(const Alloc& alloc);
+  List(size_t count, const Alloc& alloc = Alloc());
+  List(size_t count, const T& value, const Alloc& alloc = Alloc());
+  List(const List& another);
+  List(List&& another) noexcept;
+  List& operator=(const List& another);
+  List& operator=(List&& another) noexcept(
+      NodeTraits::propagate_on_container_move_assignment::value ||
+      NodeTraits::is_always_equal::value);
+  ~List() {
+    clear();
+  }
+
+  Alloc get_allocator() const {
+    return Alloc(alloc_);
+  }
+
+  size_t size() const {
+    return size_;
+  }
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  T& front() {
+    return *begin();
+  }
+  const T& front() const {
+    return *begin();
+  }
+  T& back() {
+    return *rbegin();
+  }
+  const T& back() const {
+    return *rbegin();
+  }
+
+  iterator begin() {
+    return iterator(raw(fake_.next));
+  }
+  const_iterator begin() const {
+    return const_iterator(raw(fake_.next));
+  }
+  iterator end() {
+    return iterator(&fake_);
+  }
+  const_iterator end() const {
+    return const_iterator(const_cast<BaseNode*>(&fake_));
+  }
+  const_iterator cbegin() const {
+    return begin();
+  }
+  const_iterator cend() const {
+    return end();
+  }
+
+  reverse_iterator rbegin() {
+    return reverse_iterator(end());
+  }
+  const_reverse_iterator rbegin() const {
+    return const_reverse_iterator(end());
+  }
+  reverse_iterator rend() {
+    return reverse_iterator(begin());
+  }
+  const_reverse_iterator rend() const {
+    return const_reverse_iterator(begin());
+  }
+  const_reverse_iterator crbegin() const {
+    return const_reverse_iterator(cend());
+  }
+  const_reverse_iterator crend() const {
+    return const_reverse_iterator(cbegin());
+  }
+
+  template <typename... Args>
+  iterator emplace(const_iterator pos, Args&&... args);
+  iterator insert(const_iterator pos, const T& value) {
+    return emplace(pos, value);
+  }
+  iterator insert(const_iterator pos, T&& value) {
+    return emplace(pos, std::move(value));
+  }
+  iterator erase(const_iterator pos);
+  iterator erase(const_iterator first, const_iterator last);
+
+  // Unlinks the node at pos and hands it over with its element intact.
+  node_type extract(const_iterator pos);
+  // Links the node of node before pos and leaves node empty; an empty
+  // node inserts nothing and returns pos. A node from an unequal
+  // allocator is freed after its element is moved into a new one.
+  iterator insert(const_iterator pos, node_type&& node);
+
+  void push_back(const T& value) {
+    emplace(end(), value);
+  }
+  void push_back(T&& value) {
+    emplace(end(), std::move(value));
+  }
+  void push_front(const T& value) {
+    emplace(begin(), value);
+  }
+  void push_front(T&& value) {
+    emplace(begin(), std::move(value));
+  }
+  void pop_back() {
+    erase(std::prev(end()));
+  }
+  void pop_front() {
+    erase(begin());
+  }
+
+  // Assigns over the existing elements and allocates or frees only the
+  // difference in length. Gives the basic exception guarantee.
+  template <std::input_iterator InputIt>
+  void assign(InputIt first, InputIt last);
+  void assign(size_t count, const T& value);
+
+  void clear();
+  void swap(List& another);
+
+  // The operations below relink nodes and never copy elements. Splicing
+  // between lists with unequal allocators falls back to moving elements.
+  void splice(const_iterator pos, List& another);
+  void splice(const_iterator pos, List&& another) {
+    splice(pos, another);
+  }
+  void splice(const_iterator pos, List& another, const_iterator it);
+  void splice(const_iterator pos, List&& another, const_iterator it) {
+    splice(pos, another, it);
+  }
+  // Linear in distance(first, last) unless another is *this.
+  void splice(const_iterator pos, List& another, const_iterator first,
+              const_iterator last);
+  void splice(const_iterator pos, List&& another, const_iterator first,
+              const_iterator last) {
+    splice(pos, another, first, last);
+  }
+
+  template <typename Compare>
+  void merge(List& another, Compare comp);
+  template <typename Compare>
+  void merge(List&& another, Compare comp) {
+    merge(another, comp);
+  }
+  void merge(List& another) {
+    merge(another, std::less<>());
+  }
+  void merge(List&& another) {
+    merge(another, std::less<>());
+  }
+
+  // Stable bottom-up merge sort.
+  template <typename Compare>
+  void sort(Compare comp);
+  void sort() {
+    sort(std::less<>());
+  }
+
+  template <typename BinaryPredicate>
+  size_t unique(BinaryPredicate pred);
+  size_t unique() {
+    return unique(std::equal_to<>());
+  }
+
+  template <typename Predicate>
+  size_t remove_if(Predicate pred);
+  size_t remove(const T& value) {
+    return remove_if([&value](const T& elem) { return elem == value; });
+  }
+
+  void reverse();
+
+  // Moves the elements into nodes allocated one after another in list
+  // order, so that with a stack arena a scan walks memory sequentially.
+  // Invalidates all iterators, pointers and references. The old nodes are
+  // freed only after the new ones are built, so in a StackStorage their
+  // memory stays reserved: use compact_into with a fresh storage to drop
+  // it. If an allocation throws, the list is left unchanged.
+  void compact();
+  // As compact, but the nodes come from alloc, which the list adopts.
+  void compact_into(const Alloc& alloc);
+};
+
+template <typename T, typename Alloc>
+template <typename... Args>
+typename List<T, Alloc>::Node* List<T, Alloc>::create_node(Args&&... args) {
+  NodePtr ptr = NodeTraits::allocate(alloc_, 1);
+  Node* node = std::to_address(ptr);
+  try {
+    NodeTraits::construct(alloc_, node, std::forward<Args>(args)...);
+  } catch (...) {
+    NodeTraits::deallocate(alloc_, ptr, 1);
+    throw;
+  }
+  return node;
+}
+
+template <typename T, typename Alloc>
+void List<T, Alloc>::destroy_node(BaseNode* node) {
+  Node* real = static_cast<Node*>(node);
+  NodePtr ptr = std::pointer_traits<NodePtr>::pointer_to(*real);
+  NodeTraits::destroy(alloc_, real);
+  NodeTraits::deallocate(alloc_, ptr, 1);
+}
+
+template <typename T, typename Alloc>
+void List<T, Alloc>::steal(List& another) {
+  if (another.size_ == 0) {
+    return;
+  }
+  fake_.next = another.fake_.next;
+  fake_.prev = another.fake_.prev;
+  raw(fake_.next)->prev = &fake_;
+  raw(fake_.prev)->next = &fake_;
+  size_ = another.size_;
+  another.fake_.next = another.fake_.prev = &another.fake_;
+  another.size_ = 0;
+}
+
+template <typename T, typename Alloc>
+void List<T, Alloc>::swap_nodes(List& another) {
+  std::swap(fake_.next, another.fake_.next);
+  std::swap(fake_.prev, another.fake_.prev);
+  std::swap(size_, another.size_);
+  relink_fake();
+  another.relink_fake();
+}
+
+template <typename T, typename Alloc>
+List<T, Alloc>::List(const Alloc& alloc)
+    : alloc_(alloc) {
+}
+
+template <typename T, typename Alloc>
+List<T, Alloc>::List(size_t count, const Alloc& alloc)
+    : alloc_(alloc) {
+  try {
+    for (size_t i = 0; i < count; ++i) {
+      emplace(end());
+    }
+  } catch (...) {
+    clear();
+    throw;
+  }
+}
+
+template <typename T, typename Alloc>
+List<T, Alloc>::List(size_t count, const T& value, const Alloc& alloc)
+    : alloc_(alloc) {
+  try {
+    for (size_t i = 0; i < count; ++i) {
+      emplace(end(), value);
+    }
+  } catch (...) {
+    clear();
+    throw;
+  }
+}
+
+template <typename T, typename Alloc>
+List<T, Alloc>::List(const List& another)
+    : alloc_(NodeTraits::select_on_container_copy_construction(
+          another.alloc_)) {
+  try {
+    for (const T& value : another) {
+      emplace(end(), value);
+    }
+  } catch (...) {
+    clear();
+    throw;
+  }
+}
+
+template <typename T, typename Alloc>
+List<T, Alloc>::List(List&& another) noexcept
+    : alloc_(std::move(another.alloc_)) {
+  steal(another);
+}
+
+template <typename T, typename Alloc>
+List<T, Alloc>& List<T, Alloc>::operator=(const List& another) {
+  if (this == &another) {
+    return *this;
+  }
+  if constexpr (NodeTraits::propagate_on_container_copy_assignment::value) {
+    if (alloc_ != another.alloc_) {
+      // nodes of the old allocator cannot be kept
+      clear();
+    }
+    alloc_ = another.alloc_;
+  }
+  assign(another.begin(), another.end());
+  return *this;
+}
+
+template <typename T, typename Alloc>
+List<T, Alloc>& List<T, Alloc>::operator=(List&& another) noexcept(
+    NodeTraits::propagate_on_container_move_assignment::value ||
+    NodeTraits::is_always_equal::value) {
+  if (this == &another) {
+    return *this;
+  }
+  if constexpr (NodeTraits::propagate_on_container_move_assignment::value) {
+    clear();
+    alloc_ = std::move(another.alloc_);
+    steal(another);
+  } else {
+    if (alloc_ == another.alloc_) {
+      clear();
+      steal(another);
+    } else {
+      assign(std::make_move_iterator(another.begin()),
+             std::make_move_iterator(another.end()));
+    }
+  }
+  return *this;
+}
+
+template <typename T, typename Alloc>
+template <typename... Args>
+typename List<T, Alloc>::iterator List<T, Alloc>::emplace(const_iterator pos,
+                                                          Args&&... args) {
+  Node* node = create_node(std::forward<Args>(args)...);
+  link_before(pos.node_, node);
+  ++size_;
+  return iterator(node);
+}
+
+template <typename T, typename Alloc>
+typename List<T, Alloc>::iterator List<T, Alloc>::erase(const_iterator pos) {
+  BaseNode* next = raw(pos.node_->next);
+  unlink(pos.node_);
+  destroy_node(pos.node_);
+  --size_;
+  return iterator(next);
+}
+
+template <typename T, typename Alloc>
+typename List<T, Alloc>::iterator List<T, Alloc>::erase(const_iterator first,
+                                                        const_iterator last) {
+  while (first != last) {
+    first = erase(first);
+  }
+  return iterator(last.node_);
+}
+
+template <typename T, typename Alloc>
+typename List<T, Alloc>::node_type List<T, Alloc>::extract(
+    const_iterator pos) {
+  unlink(pos.node_);
+  --size_;
+  return node_type(static_cast<Node*>(pos.node_), alloc_);
+}
+
+template <typename T, typename Alloc>
+typename List<T, Alloc>::iterator List<T, Alloc>::insert(const_iterator pos,
+                                                         node_type&& node) {
+  if (node.empty()) {
+    return iterator(pos.node_);
+  }
+  if (*node.alloc_ != alloc_) {
+    iterator it = emplace(pos, std::move(node.value()));
+    node = node_type();
+    return it;
+  }
+  Node* raw_node = std::exchange(node.node_, nullptr);
+  node.alloc_.reset();
+  link_before(pos.node_, raw_node);
+  ++size_;
+  return iterator(raw_node);
+}
+
+template <typename T, typename Alloc>
+template <std::input_iterator InputIt>
+void List<T, Alloc>::assign(InputIt first, InputIt last) {
+  iterator it = begin();
+  for (; it != end() && first != last; ++it, ++first) {
+    *it = *first;
+  }
+  if (first == last) {
+    erase(it, end());
+    return;
+  }
+  for (; first != last; ++first) {
+    emplace(end(), *first);
+  }
+}
+
+template <typename T, typename Alloc>
+void List<T, Alloc>::assign(size_t count, const T& value) {
+  iterator it = begin();
+  for (; it != end() && count > 0; ++it, --count) {
+    *it = value;
+  }
+  if (count == 0) {
+    erase(it, end());
+    return;
+  }
+  for (; count > 0; --count) {
+    emplace(end(), value);
+  }
+}
+
+template <typename T, typename Alloc>
+void List<T, Alloc>::clear() {
+  if constexpr (!drops_nodes) {
+    BaseNode* node = raw(fake_.next);
+    while (node != &fake_) {
+      BaseNode* next = raw(node->next);
+      destroy_node(node);
+      node = next;
+    }
+  }
+  fake_.next = fake_.prev = &fake_;
+  size_ = 0;
+}
+
+template <typename T, typename Alloc>
+void List<T, Alloc>::swap(List& another) {
+  swap_nodes(another);
+  if constexpr (NodeTraits::propagate_on_container_swap::value) {
+    std::swap(alloc_, another.alloc_);
+  }
+}
+
+template <typename T, typename Alloc>
+void List<T, Alloc>::splice(const_iterator pos, List& another) {
+  if (this == &another || another.size_ == 0) {
+    return;
+  }
+  if (alloc_ != another.alloc_) {
+    splice(pos, another, another.begin(), another.end());
+    return;
+  }
+  transfer(pos.node_, raw(another.fake_.next), &another.fake_);
+  size_ += another.size_;
+  another.size_ = 0;
+}
+
+template <typename T, typename Alloc>
+void List<T, Alloc>::splice(const_iterator pos, List& another,
+                            const_iterator it) {
+  if (pos == it || pos.node_ == raw(it.node_->next)) {
+    return;
+  }
+  if (this != &another && alloc_ != another.alloc_) {
+    emplace(pos, std::move(static_cast<Node*>(it.node_)->value));
+    another.erase(it);
+    return;
+  }
+  unlink(it.node_);
+  link_before(pos.node_, it.node_);
+  --another.size_;
+  ++size_;
+}
+
+template <typename T, typename Alloc>
+void List<T, Alloc>::splice(const_iterator pos, List& another,
+                            const_iterator first, const_iterator last) {
+  if (this == &another) {
+    transfer(pos.node_, first.node_, last.node_);
+    return;
+  }
+  if (alloc_ != another.alloc_) {
+    while (first != last) {
+      emplace(pos, std::move(static_cast<Node*>(first.node_)->value));
+      first = another.erase(first);
+    }
+    return;
+  }
+  size_t count = std::distance(first, last);
+  transfer(pos.node_, first.node_, last.node_);
+  size_ += count;
+  another.size_ -= count;
+}
+
+template <typename T, typename Alloc>
+template <typename Compare>
+typename List<T, Alloc>::BaseNode* List<T, Alloc>::merge_chains(
+    BaseNode* left, BaseNode* right, Compare& comp) {
+  BaseNode head{nullptr, nullptr};
+  BaseNode* tail = &head;
+  while (left != nullptr && right != nullptr) {
+    if (comp(static_cast<Node*>(right)->value,
+             static_cast<Node*>(left)->value)) {
+      tail->next = right;
+      right = raw(right->next);
+    } else {
+      tail->next = left;
+      left = raw(left->next);
+    }
+    tail = raw(tail->next);
+  }
+  tail->next = (left != nullptr ? left : right);
+  return raw(head.next);
+}
+
+template <typename T, typename Alloc>
+template <typename Compare>
+void List<T, Alloc>::merge(List& another, Compare comp) {
+  if (this == &another || another.size_ == 0) {
+    return;
+  }
+  if (alloc_ != another.alloc_) {
+    iterator it = begin();
+    while (!another.empty()) {
+      while (it != end() && !comp(another.front(), *it)) {
+        ++it;
+      }
+      splice(it, another, another.begin());
+    }
+    return;
+  }
+  BaseNode* node = raw(fake_.next);
+  BaseNode* other = raw(another.fake_.next);
+  while (node != &fake_ && other != &another.fake_) {
+    if (comp(static_cast<Node*>(other)->value,
+             static_cast<Node*>(node)->value)) {
+      BaseNode* next = raw(other->next);
+      unlink(other);
+      link_before(node, other);
+      other = next;
+    } else {
+      node = raw(node->next);
+    }
+  }
+  transfer(&fake_, other, &another.fake_);
+  size_ += another.size_;
+  another.size_ = 0;
+}
+
+template <typename T, typename Alloc>
+template <typename Compare>
+void List<T, Alloc>::sort(Compare comp) {
+  if (size_ < 2) {
+    return;
+  }
+  // bins[i] holds a sorted run of 2^i nodes, earlier runs in higher bins
+  BaseNode* bins[64] = {};
+  BaseNode* node = raw(fake_.next);
+  while (node != &fake_) {
+    BaseNode* carry = node;
+    node = raw(node->next);
+    carry->next = nullptr;
+    size_t i = 0;
+    for (; bins[i] != nullptr; ++i) {
+      carry = merge_chains(bins[i], carry, comp);
+      bins[i] = nullptr;
+    }
+    bins[i] = carry;
+  }
+  BaseNode* result = nullptr;
+  for (BaseNode* bin : bins) {
+    if (bin != nullptr) {
+      result = merge_chains(bin, result, comp);
+    }
+  }
+  BaseNode* prev = &fake_;
+  for (; result != nullptr; result = raw(result->next)) {
+    prev->next = result;
+    result->prev = prev;
+    prev = result;
+  }
+  prev->next = &fake_;
+  fake_.prev = prev;
+}
+
+template <typename T, typename Alloc>
+template <typename BinaryPredicate>
+size_t List<T, Alloc>::unique(BinaryPredicate pred) {
+  size_t removed = 0;
+  if (size_ < 2) {
+    return removed;
+  }
+  iterator first = begin();
+  iterator next = std::next(first);
+  while (next != end()) {
+    if (pred(*first, *next)) {
+      next = erase(next);
+      ++removed;
+    } else {
+      first = next++;
+    }
+  }
+  return removed;
+}
+
+template <typename T, typename Alloc>
+template <typename Predicate>
+size_t List<T, Alloc>::remove_if(Predicate pred) {
+  // Removed nodes are kept alive until the end, pred may refer to one of them
+  List removed(alloc_);
+  iterator it = begin();
+  while (it != end()) {
+    iterator next = std::next(it);
+    if (pred(*it)) {
+      removed.splice(removed.end(), *this, it);
+    }
+    it = next;
+  }
+  return removed.size();
+}
+
+template <typename T, typename Alloc>
+void List<T, Alloc>::reverse() {
+  BaseNode* node = &fake_;
+  do {
+    BasePtr next = node->next;
+    node->next = node->prev;
+    node->prev = next;
+    node = raw(node->prev);
+  } while (node != &fake_);
+}
+
+template <typename T, typename Alloc>
+List<T, Alloc> List<T, Alloc>::relocated(const Alloc& alloc) {
+  List result(alloc);
+  iterator it = begin();
+  try {
+    for (; it != end(); ++it) {
+      result.emplace(result.end(), std::move_if_noexcept(*it));
+    }
+  } catch (...) {
+    if constexpr (std::is_nothrow_move_constructible_v<T>) {
+      std::move(result.begin(), result.end(), begin());
+    }
+    throw;
+  }
+  return result;
+}
+
+template <typename T, typename Alloc>
+void List<T, Alloc>::compact() {
+  List result = relocated(get_allocator());
+  clear();
+  steal(result);
+}
+
+template <typename T, typename Alloc>
+void List<T, Alloc>::compact_into(const Alloc& alloc) {
+  List result = relocated(alloc);
+  clear();
+  alloc_ = result.alloc_;
+  steal(result);
+}
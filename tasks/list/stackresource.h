@@ -0,0 +1,141 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+
+// std::pmr view of a stack arena: StackStorage, MappedStackStorage or
+// anything else with allocate(bytes, alignment) and deallocate(ptr, bytes).
+// Containers using it through polymorphic_allocator do not depend on the
+// arena size, so std::pmr containers and List<T,
+// std::pmr::polymorphic_allocator<T>> can all share one arena.
+template <typename Storage>
+class StackResource : public std::pmr::memory_resource {
+ private:
+  Storage* storage_;
+
+  void* do_allocate(size_t bytes, size_t alignment) override {
+    return storage_->allocate(bytes, alignment);
+  }
+  void do_deallocate(void* ptr, size_t bytes, size_t /*alignment*/) override {
+    storage_->deallocate(ptr, bytes);
+  }
+  bool do_is_equal(const std::pmr::memory_resource& another)
+      const noexcept override {
+    const auto* resource = dynamic_cast<const StackResource*>(&another);
+    return resource != nullptr && resource->storage_ == storage_;
+  }
+
+ public:
+  explicit StackResource(Storage& storage)
+      : storage_(&storage) {
+  }
+
+  Storage& storage() const {
+    return *storage_;
+  }
+};
+
+template <typename Storage>
+StackResource(Storage&) -> StackResource<Storage>;
+
+// Stack arena that grows instead of throwing: when a block runs out, the
+// next one, twice as large, is taken from the upstream resource. As in
+// StackStorage, only the topmost allocation of the current block is given
+// back on deallocate; blocks go back upstream in release() and on
+// destruction. Plugged in as the upstream of
+// std::pmr::unsynchronized_pool_resource it gives a pool whose chunks are
+// carved out of the arena.
+class GrowingStackResource : public std::pmr::memory_resource {
+ private:
+  struct Block {
+    Block* prev;
+    size_t size;
+  };
+
+  std::pmr::memory_resource* upstream_;
+  Block* block_ = nullptr;
+  char* begin_ = nullptr;
+  size_t shift_ = 0;
+  size_t capacity_ = 0;
+  size_t next_size_;
+
+  void grow(size_t bytes, size_t alignment);
+
+  void* do_allocate(size_t bytes, size_t alignment) override;
+  void do_deallocate(void* ptr, size_t bytes, size_t alignment) override;
+  bool do_is_equal(const std::pmr::memory_resource& another)
+      const noexcept override {
+    return this == &another;
+  }
+
+ public:
+  static const size_t default_block_size = 4096;
+
+  explicit GrowingStackResource(
+      size_t initial_size = default_block_size,
+      std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+      : upstream_(upstream),
+        next_size_(std::max(initial_size, sizeof(Block))) {
+  }
+  GrowingStackResource(const GrowingStackResource&) = delete;
+  GrowingStackResource& operator=(const GrowingStackResource&) = delete;
+  ~GrowingStackResource() override {
+    release();
+  }
+
+  // Returns every block upstream. Everything allocated from the resource
+  // becomes invalid.
+  void release();
+
+  std::pmr::memory_resource* upstream_resource() const {
+    return upstream_;
+  }
+};
+
+inline void GrowingStackResource::grow(size_t bytes, size_t alignment) {
+  size_t needed = sizeof(Block) + bytes + alignment;
+  while (next_size_ < needed) {
+    next_size_ *= 2;
+  }
+  void* memory = upstream_->allocate(next_size_, alignof(std::max_align_t));
+  block_ = new (memory) Block{block_, next_size_};
+  begin_ = static_cast<char*>(memory);
+  shift_ = sizeof(Block);
+  capacity_ = next_size_;
+  next_size_ *= 2;
+}
+
+inline void* GrowingStackResource::do_allocate(size_t bytes,
+                                               size_t alignment) {
+  void* ptr = begin_ + shift_;
+  size_t space = capacity_ - shift_;
+  if (block_ == nullptr ||
+      std::align(alignment, bytes, ptr, space) == nullptr) {
+    grow(bytes, alignment);
+    ptr = begin_ + shift_;
+    space = capacity_ - shift_;
+    std::align(alignment, bytes, ptr, space);
+  }
+  shift_ = capacity_ - space + bytes;
+  return ptr;
+}
+
+inline void GrowingStackResource::do_deallocate(void* ptr, size_t bytes,
+                                                size_t /*alignment*/) {
+  char* block = static_cast<char*>(ptr);
+  if (block_ != nullptr && block + bytes == begin_ + shift_) {
+    shift_ = block - begin_;
+  }
+}
+
+inline void GrowingStackResource::release() {
+  while (block_ != nullptr) {
+    Block* prev = block_->prev;
+    upstream_->deallocate(block_, block_->size, alignof(std::max_align_t));
+    block_ = prev;
+  }
+  begin_ = nullptr;
+  shift_ = capacity_ = 0;
+}
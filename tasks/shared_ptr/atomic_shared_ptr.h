@@ -0,0 +1,218 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <utility>
+
+#include "shared_ptr.h"
+
+// A SharedPtr that threads can load and replace concurrently without a
+// lock, for snapshots that many readers take and few writers publish.
+//
+// The stored value lives in a heap node whose address shares one atomic
+// word with a count of the loads in progress (split reference counting).
+// A load adds to that count, copies the SharedPtr out of the node and
+// takes the count back. A writer that swaps the node out moves the count
+// of unfinished loads into the node's own counter, and the node is freed
+// once each of those loads has given its share back. Every operation is a
+// bounded number of atomic steps or a compare-and-swap loop that only
+// retries when another thread made progress.
+//
+// Each store allocates a node. The load count has 16 bits: at most 65535
+// loads of one AtomicSharedPtr may be in progress at the same time.
+//
+// The node address gets the low 48 bits of the word, so the platform must
+// hand out heap addresses below 2^48: x86-64 with 4-level paging and
+// AArch64 with 48-bit virtual addresses do. 57-bit address spaces (x86-64
+// LA57) and pointers with tags or other data in the top byte (AArch64 TBI,
+// MTE, hardware-assisted sanitizers) may not fit; in safe mode pack()
+// asserts that the top 16 bits of every node address are zero.
+template <typename T>
+class AtomicSharedPtr {
+ private:
+  struct Node {
+    // Loads this node still owes once it is no longer stored: negative
+    // while the writer has not moved the load count over yet.
+    std::atomic<int64_t> debt{0};
+    SharedPtr<T> value;
+
+    explicit Node(SharedPtr<T> value)
+        : value(std::move(value)) {
+    }
+  };
+
+  static const int pointer_bits = 48;
+  static const uint64_t pointer_mask = (uint64_t{1} << pointer_bits) - 1;
+  static const uint64_t one_load = uint64_t{1} << pointer_bits;
+
+  mutable std::atomic<uint64_t> word_{0};
+
+  static Node* node_of(uint64_t word) {
+    auto address = static_cast<uintptr_t>(word & pointer_mask);
+    return reinterpret_cast<Node*>(address);
+  }
+  static uint64_t loads_of(uint64_t word) {
+    return word >> pointer_bits;
+  }
+  static uint64_t pack(Node* node) {
+    auto address = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(node));
+    // safe mode: a wider address would lose its top bits to the count
+    assert((address & ~pointer_mask) == 0);
+    return address;
+  }
+  static bool empty(const SharedPtr<T>& value) {
+    return value.ptr_ == nullptr && value.block_ == nullptr;
+  }
+  static Node* make_node(SharedPtr<T>&& value) {
+    return empty(value) ? nullptr : new Node(std::move(value));
+  }
+
+  // Registers a load of the current node, which then stays alive until
+  // finish_load. Returns the word as it was before.
+  uint64_t start_load() const;
+  void finish_load(Node* node) const;
+  // Called by the thread that swapped old_word out: adds the loads that
+  // were in progress, minus the own ones, to the node's debt.
+  static void retire(uint64_t old_word, int64_t own_loads);
+
+ public:
+  using value_type = SharedPtr<T>;
+
+  static constexpr bool is_always_lock_free =
+      std::atomic<uint64_t>::is_always_lock_free;
+
+  AtomicSharedPtr() = default;
+  AtomicSharedPtr(SharedPtr<T> value)
+      : word_(pack(make_node(std::move(value)))) {
+  }
+  AtomicSharedPtr(const AtomicSharedPtr&) = delete;
+  AtomicSharedPtr& operator=(const AtomicSharedPtr&) = delete;
+
+  ~AtomicSharedPtr() {
+    retire(word_.load(std::memory_order_acquire), 0);
+  }
+
+  bool is_lock_free() const {
+    return word_.is_lock_free();
+  }
+
+  SharedPtr<T> load() const;
+  void store(SharedPtr<T> value) {
+    exchange(std::move(value));
+  }
+  SharedPtr<T> exchange(SharedPtr<T> value);
+  // Succeeds if the stored pointer equals expected and shares ownership
+  // with it; otherwise expected receives the stored pointer.
+  bool compare_exchange_strong(SharedPtr<T>& expected, SharedPtr<T> desired);
+  bool compare_exchange_weak(SharedPtr<T>& expected, SharedPtr<T> desired) {
+    return compare_exchange_strong(expected, std::move(desired));
+  }
+
+  operator SharedPtr<T>() const {
+    return load();
+  }
+  AtomicSharedPtr& operator=(SharedPtr<T> value) {
+    store(std::move(value));
+    return *this;
+  }
+};
+
+template <typename T>
+uint64_t AtomicSharedPtr<T>::start_load() const {
+  return word_.fetch_add(one_load, std::memory_order_acquire);
+}
+
+template <typename T>
+void AtomicSharedPtr<T>::finish_load(Node* node) const {
+  if (node == nullptr) {
+    // An empty value has no node to keep alive. Its load count is left
+    // as it is and simply wraps around.
+    return;
+  }
+  uint64_t word = word_.load(std::memory_order_relaxed);
+  while (node_of(word) == node) {
+    // the release orders this load's reads of the node before the
+    // writer that later swaps it out
+    if (word_.compare_exchange_weak(word, word - one_load,
+                                    std::memory_order_release,
+                                    std::memory_order_relaxed)) {
+      return;
+    }
+  }
+  // the node was swapped out and the writer counted this load as owed
+  if (node->debt.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    delete node;
+  }
+}
+
+template <typename T>
+void AtomicSharedPtr<T>::retire(uint64_t old_word, int64_t own_loads) {
+  Node* node = node_of(old_word);
+  if (node == nullptr) {
+    return;
+  }
+  auto owed = static_cast<int64_t>(loads_of(old_word)) - own_loads;
+  if (node->debt.fetch_add(owed, std::memory_order_acq_rel) + owed == 0) {
+    delete node;
+  }
+}
+
+template <typename T>
+SharedPtr<T> AtomicSharedPtr<T>::load() const {
+  Node* node = node_of(start_load());
+  if (node == nullptr) {
+    return SharedPtr<T>();
+  }
+  SharedPtr<T> result = node->value;
+  finish_load(node);
+  return result;
+}
+
+template <typename T>
+SharedPtr<T> AtomicSharedPtr<T>::exchange(SharedPtr<T> value) {
+  Node* node = make_node(std::move(value));
+  uint64_t old_word = word_.exchange(pack(node), std::memory_order_acq_rel);
+  Node* old_node = node_of(old_word);
+  SharedPtr<T> result;
+  if (old_node != nullptr) {
+    // loads still in progress may be copying the value: copy it too
+    result = old_node->value;
+  }
+  retire(old_word, 0);
+  return result;
+}
+
+template <typename T>
+bool AtomicSharedPtr<T>::compare_exchange_strong(SharedPtr<T>& expected,
+                                                 SharedPtr<T> desired) {
+  Node* desired_node = nullptr;
+  while (true) {
+    Node* node = node_of(start_load());
+    bool equal = (node == nullptr ? empty(expected)
+                                  : node->value.ptr_ == expected.ptr_ &&
+                                        node->value.block_ == expected.block_);
+    if (!equal) {
+      expected = (node == nullptr ? SharedPtr<T>() : node->value);
+      finish_load(node);
+      delete desired_node;
+      return false;
+    }
+    if (desired_node == nullptr && !empty(desired)) {
+      desired_node = new Node(std::move(desired));
+    }
+
+    uint64_t word = word_.load(std::memory_order_relaxed);
+    while (node_of(word) == node) {
+      if (word_.compare_exchange_weak(word, pack(desired_node),
+                                      std::memory_order_acq_rel,
+                                      std::memory_order_relaxed)) {
+        // our own load is among the ones counted in word
+        retire(word, 1);
+        return true;
+      }
+    }
+    // swapped out by someone else in between, compare again
+    finish_load(node);
+  }
+}
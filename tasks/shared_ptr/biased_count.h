@@ -0,0 +1,331 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "shared_ptr.h"
+
+class BiasedCount;
+
+// Per-thread record of a BiasedCount owner: the queue through which other
+// threads ask it to merge counts. It outlives its thread while counts
+// still refer to it; pushes to the record of a finished thread fail and
+// the pushing thread merges the count itself.
+class BiasedOwner {
+ private:
+  std::mutex mutex_;
+  std::vector<BiasedCount*> queue_;
+  bool alive_ = true;
+  std::atomic<bool> pending_{false};
+  std::atomic<size_t> refs_{1};
+
+  // Trivially destructible, so they can still be read after the holder is
+  // destroyed by a count operation in another thread-local destructor.
+  static BiasedOwner*& slot() {
+    thread_local BiasedOwner* owner = nullptr;
+    return owner;
+  }
+  static bool& gone() {
+    thread_local bool gone = false;
+    return gone;
+  }
+
+  struct Holder {
+    ~Holder() {
+      gone() = true;
+      if (slot() != nullptr) {
+        slot()->exit();
+      }
+    }
+  };
+
+  BiasedOwner() = default;
+  // The record of a count made after its thread finished: it is finished
+  // too, and only the count refers to it.
+  explicit BiasedOwner(bool finished)
+      : alive_(!finished),
+        refs_(0) {
+  }
+
+  void exit();
+
+ public:
+  // The record of the calling thread, nullptr if it never owned a count
+  // or has finished.
+  static BiasedOwner* find() {
+    return slot();
+  }
+  static BiasedOwner* current() {
+    BiasedOwner*& owner = slot();
+    if (owner == nullptr) {
+      if (gone()) {
+        return new BiasedOwner(true);
+      }
+      thread_local Holder holder;
+      owner = new BiasedOwner();
+    }
+    return owner;
+  }
+
+  void retain() {
+    refs_.fetch_add(1, std::memory_order_relaxed);
+  }
+  void release() {
+    if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete this;
+    }
+  }
+
+  // False if the owner has finished.
+  bool push(BiasedCount* count);
+  bool pending() const {
+    return pending_.load(std::memory_order_relaxed);
+  }
+  // Merges every queued count, run by the owner.
+  void drain();
+};
+
+// Biased reference counting: the thread that creates the object counts
+// with plain loads and stores, other threads with an atomic counter that
+// may go negative. When the owner's count drops to zero the two are
+// merged and the count behaves like AtomicCount from then on.
+//
+// A reference can leave the owner thread without a count operation (a
+// moved SharedPtr) and be dropped elsewhere. The thread whose decrement
+// first takes the atomic counter below zero queues the count with the
+// owner, which merges it at its next count operation or when it exits, so
+// such objects are destroyed late but never leak. Copies made by other
+// threads stay as expensive as with AtomicCount: the policy pays off for
+// objects used mostly by the thread that made them.
+class BiasedCount {
+ private:
+  // shared_ holds count * unit with the two flags in the low bits.
+  static const int64_t merged_bit = 1;
+  static const int64_t queued_bit = 2;
+  static const int64_t unit = 4;
+
+  // owner_ is cleared by the merge, record_ stays for the pushes and holds
+  // a reference to the record until the count is merged and off the queue.
+  BiasedOwner* const record_;
+  std::atomic<BiasedOwner*> owner_;
+  std::atomic<int64_t> biased_;
+  std::atomic<int64_t> shared_{0};
+  void (*zero_handler_)(void*) = nullptr;
+  void* zero_context_ = nullptr;
+
+  friend class BiasedOwner;
+
+  static int64_t count_of(int64_t word) {
+    return word >> 2;
+  }
+  // The queue is drained first: it may hold this very count.
+  bool owned_by_caller() const {
+    BiasedOwner* caller = BiasedOwner::find();
+    if (caller == nullptr) {
+      return false;
+    }
+    if (caller->pending()) {
+      caller->drain();
+    }
+    return owner_.load(std::memory_order_relaxed) == caller;
+  }
+
+  // Folds the owner's count into shared_, run by the owner or, once it has
+  // finished, by any thread. Returns the word before the merge.
+  int64_t merge();
+  // Merges a queued count and clears its queued bit. Whoever clears the
+  // bit of a zero count destroys the object.
+  void merge_queued();
+
+ public:
+  using weak_count_type = AtomicCount;
+
+  explicit BiasedCount(size_t value)
+      : record_(BiasedOwner::current()),
+        owner_(record_),
+        biased_(static_cast<int64_t>(value)) {
+    record_->retain();
+  }
+  BiasedCount(const BiasedCount&) = delete;
+  BiasedCount& operator=(const BiasedCount&) = delete;
+
+  void set_zero_handler(void (*handler)(void*), void* context) {
+    zero_handler_ = handler;
+    zero_context_ = context;
+  }
+
+  // Merges the counts other threads queued with the calling thread, as
+  // its next count operation would. A thread that creates objects and
+  // then only waits can call it to have them destroyed in time.
+  static void merge_pending() {
+    BiasedOwner* caller = BiasedOwner::find();
+    if (caller != nullptr && caller->pending()) {
+      caller->drain();
+    }
+  }
+
+  void increment();
+  bool decrement();
+  bool try_increment();
+  size_t load() const {
+    int64_t shared = count_of(shared_.load(std::memory_order_relaxed));
+    return static_cast<size_t>(biased_.load(std::memory_order_relaxed) +
+                               shared);
+  }
+};
+
+template <typename T>
+using BiasedSharedPtr = SharedPtr<T, BiasedCount>;
+template <typename T>
+using BiasedWeakPtr = WeakPtr<T, BiasedCount>;
+
+template <typename T, typename... Args>
+BiasedSharedPtr<T> make_biased_shared(Args&&... args) {
+  return makeShared<T, BiasedCount>(std::forward<Args>(args)...);
+}
+
+inline bool BiasedOwner::push(BiasedCount* count) {
+  {
+    std::lock_guard lock(mutex_);
+    if (alive_) {
+      queue_.push_back(count);
+      pending_.store(true, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  return false;
+}
+
+inline void BiasedOwner::drain() {
+  std::vector<BiasedCount*> queue;
+  {
+    std::lock_guard lock(mutex_);
+    queue.swap(queue_);
+    pending_.store(false, std::memory_order_relaxed);
+  }
+  for (BiasedCount* count : queue) {
+    count->merge_queued();
+  }
+}
+
+inline void BiasedOwner::exit() {
+  drain();
+  std::vector<BiasedCount*> queue;
+  {
+    std::lock_guard lock(mutex_);
+    alive_ = false;
+    queue.swap(queue_);
+  }
+  for (BiasedCount* count : queue) {
+    count->merge_queued();
+  }
+  slot() = nullptr;
+  release();
+}
+
+inline int64_t BiasedCount::merge() {
+  int64_t biased = biased_.load(std::memory_order_relaxed);
+  biased_.store(0, std::memory_order_relaxed);
+  owner_.store(nullptr, std::memory_order_relaxed);
+  int64_t old = shared_.fetch_add(biased * unit + merged_bit,
+                                  std::memory_order_acq_rel);
+  if ((old & queued_bit) == 0) {
+    record_->release();
+  }
+  return old + biased * unit;
+}
+
+inline void BiasedCount::merge_queued() {
+  if (owner_.load(std::memory_order_relaxed) != nullptr) {
+    merge();
+  }
+  BiasedOwner* record = record_;
+  int64_t old = shared_.fetch_and(~queued_bit, std::memory_order_acq_rel);
+  record->release();
+  if (count_of(old) == 0) {
+    zero_handler_(zero_context_);
+  }
+}
+
+inline void BiasedCount::increment() {
+  if (owned_by_caller()) {
+    biased_.store(biased_.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+    return;
+  }
+  shared_.fetch_add(unit, std::memory_order_relaxed);
+}
+
+inline bool BiasedCount::decrement() {
+  if (owned_by_caller()) {
+    int64_t biased = biased_.load(std::memory_order_relaxed) - 1;
+    biased_.store(biased, std::memory_order_relaxed);
+    if (biased != 0) {
+      return false;
+    }
+    int64_t word = merge();
+    // a queued count is destroyed by whoever takes it off the queue
+    return count_of(word) == 0 && (word & queued_bit) == 0;
+  }
+
+  int64_t old = shared_.load(std::memory_order_relaxed);
+  if ((old & merged_bit) != 0) {
+    old = shared_.fetch_sub(unit, std::memory_order_release);
+    if (count_of(old) == 1 && (old & queued_bit) == 0) {
+      shared_.load(std::memory_order_acquire);
+      return true;
+    }
+    return false;
+  }
+
+  // Before the merge the decrement and the decision to queue must be one
+  // step, or the owner could merge and destroy in between.
+  int64_t desired = 0;
+  do {
+    desired = old - unit;
+    if ((old & merged_bit) == 0 && count_of(desired) < 0) {
+      desired |= queued_bit;
+    }
+  } while (!shared_.compare_exchange_weak(old, desired,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed));
+  if ((old & merged_bit) != 0) {
+    if (count_of(desired) == 0 && (old & queued_bit) == 0) {
+      shared_.load(std::memory_order_acquire);
+      return true;
+    }
+    return false;
+  }
+  if ((desired & queued_bit) != 0 && (old & queued_bit) == 0) {
+    if (!record_->push(this)) {
+      // the owner is gone and its counts can no longer change
+      merge_queued();
+    }
+  }
+  return false;
+}
+
+inline bool BiasedCount::try_increment() {
+  if (owned_by_caller()) {
+    biased_.store(biased_.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+    return true;
+  }
+  int64_t old = shared_.load(std::memory_order_relaxed);
+  do {
+    // Until the merge the owner's part counts too: with a merge queued
+    // the sum may already be zero, and the object is as good as gone.
+    int64_t count = count_of(old);
+    if ((old & merged_bit) == 0) {
+      count += biased_.load(std::memory_order_relaxed);
+    }
+    if (count <= 0) {
+      return false;
+    }
+  } while (!shared_.compare_exchange_weak(old, old + unit,
+                                          std::memory_order_relaxed));
+  return true;
+}
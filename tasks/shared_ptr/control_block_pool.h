@@ -0,0 +1,248 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <new>
+
+// Free lists of small blocks for SharedPtr control blocks, in size
+// classes of alignof(std::max_align_t). A released block waits in its
+// list for the next control block of that size, so creating and dropping
+// pointers in a steady state never reaches the upstream allocator; it is
+// only asked on a miss and takes back what exceeds the limit per class.
+//
+// Upstream may be StackAllocator to carve the blocks out of a
+// StackStorage. A pool is not thread-safe: SharedPtr uses one per thread
+// through LocalPoolAllocator, an explicit pool goes with PoolAllocator.
+template <typename Upstream = std::allocator<std::byte>>
+class ControlBlockPool {
+ private:
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+
+  using Unit = std::max_align_t;
+  using UnitAlloc =
+      typename std::allocator_traits<Upstream>::template rebind_alloc<Unit>;
+  using UnitTraits = std::allocator_traits<UnitAlloc>;
+
+  static const size_t granularity = sizeof(Unit);
+  static const size_t classes = 8;
+
+  struct FreeList {
+    FreeBlock* head = nullptr;
+    size_t size = 0;
+  };
+
+  UnitAlloc upstream_;
+  size_t limit_;
+  std::array<FreeList, classes> free_;
+  size_t upstream_allocations_ = 0;
+
+  static size_t units(size_t bytes) {
+    return (bytes + granularity - 1) / granularity;
+  }
+
+ public:
+  static const size_t max_block_size = classes * granularity;
+  static const size_t default_limit = 4096;
+
+  explicit ControlBlockPool(const Upstream& upstream = Upstream(),
+                            size_t limit = default_limit)
+      : upstream_(upstream),
+        limit_(limit) {
+  }
+  ControlBlockPool(const ControlBlockPool&) = delete;
+  ControlBlockPool& operator=(const ControlBlockPool&) = delete;
+  ~ControlBlockPool() {
+    release();
+  }
+
+  // The pool of the calling thread, nullptr once the thread has destroyed
+  // it on exit.
+  static ControlBlockPool* local();
+
+  // bytes must not exceed max_block_size.
+  void* allocate(size_t bytes);
+  void deallocate(void* ptr, size_t bytes);
+  // Returns every free block upstream.
+  void release();
+
+  size_t upstream_allocations() const {
+    return upstream_allocations_;
+  }
+  size_t free_blocks() const {
+    size_t total = 0;
+    for (const FreeList& list : free_) {
+      total += list.size;
+    }
+    return total;
+  }
+};
+
+template <typename Upstream>
+ControlBlockPool<Upstream>* ControlBlockPool<Upstream>::local() {
+  struct Holder {
+    ControlBlockPool pool;
+    bool* gone;
+
+    ~Holder() {
+      *gone = true;
+    }
+  };
+  // trivially destructible, so it can still be read after the holder is
+  // destroyed by a SharedPtr that another thread-local object releases
+  thread_local bool gone = false;
+  if (gone) {
+    return nullptr;
+  }
+  thread_local Holder holder{ControlBlockPool(), &gone};
+  return &holder.pool;
+}
+
+template <typename Upstream>
+void* ControlBlockPool<Upstream>::allocate(size_t bytes) {
+  size_t count = units(bytes);
+  FreeList& list = free_[count - 1];
+  if (list.head != nullptr) {
+    FreeBlock* block = list.head;
+    list.head = block->next;
+    --list.size;
+    return block;
+  }
+  ++upstream_allocations_;
+  return std::to_address(UnitTraits::allocate(upstream_, count));
+}
+
+template <typename Upstream>
+void ControlBlockPool<Upstream>::deallocate(void* ptr, size_t bytes) {
+  size_t count = units(bytes);
+  FreeList& list = free_[count - 1];
+  if (list.size == limit_) {
+    UnitTraits::deallocate(upstream_, static_cast<Unit*>(ptr), count);
+    return;
+  }
+  list.head = new (ptr) FreeBlock{list.head};
+  ++list.size;
+}
+
+template <typename Upstream>
+void ControlBlockPool<Upstream>::release() {
+  for (size_t i = 0; i < classes; ++i) {
+    FreeList& list = free_[i];
+    while (list.head != nullptr) {
+      FreeBlock* block = list.head;
+      list.head = block->next;
+      UnitTraits::deallocate(upstream_, reinterpret_cast<Unit*>(block), i + 1);
+    }
+    list.size = 0;
+  }
+}
+
+// Allocator over an explicit ControlBlockPool, for the Alloc argument of
+// SharedPtr. Requests the pool cannot serve go to std::allocator.
+template <typename T, typename Pool = ControlBlockPool<>>
+class PoolAllocator {
+ private:
+  Pool* pool_;
+
+  template <typename U, typename P>
+  friend class PoolAllocator;
+
+  static bool pooled(size_t count) {
+    return count == 1 && sizeof(T) <= Pool::max_block_size &&
+           alignof(T) <= alignof(std::max_align_t);
+  }
+
+ public:
+  using value_type = T;
+
+  PoolAllocator(Pool& pool)
+      : pool_(&pool) {
+  }
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U, Pool>& another)
+      : pool_(another.pool_) {
+  }
+
+  T* allocate(size_t count) {
+    if (!pooled(count)) {
+      return std::allocator<T>().allocate(count);
+    }
+    return static_cast<T*>(pool_->allocate(sizeof(T)));
+  }
+  void deallocate(T* ptr, size_t count) {
+    if (!pooled(count)) {
+      std::allocator<T>().deallocate(ptr, count);
+      return;
+    }
+    pool_->deallocate(ptr, sizeof(T));
+  }
+
+  template <typename U>
+  bool operator==(const PoolAllocator<U, Pool>& another) const {
+    return pool_ == another.pool_;
+  }
+  template <typename U>
+  bool operator!=(const PoolAllocator<U, Pool>& another) const {
+    return !(*this == another);
+  }
+};
+
+// Stateless allocator over the pool of the calling thread. A block freed
+// by another thread joins that thread's pool, which is safe because the
+// pools allocate blocks one by one from the same upstream. During thread
+// exit, after the pool is gone, blocks go to that upstream directly.
+template <typename T>
+class LocalPoolAllocator {
+ private:
+  using Pool = ControlBlockPool<>;
+  using Unit = std::max_align_t;
+
+  static const size_t units = (sizeof(T) + sizeof(Unit) - 1) / sizeof(Unit);
+
+  static bool pooled(size_t count) {
+    return count == 1 && sizeof(T) <= Pool::max_block_size &&
+           alignof(T) <= alignof(Unit);
+  }
+
+ public:
+  using value_type = T;
+
+  LocalPoolAllocator() = default;
+  template <typename U>
+  LocalPoolAllocator(const LocalPoolAllocator<U>& /*another*/) {
+  }
+
+  T* allocate(size_t count) {
+    if (!pooled(count)) {
+      return std::allocator<T>().allocate(count);
+    }
+    Pool* pool = Pool::local();
+    if (pool == nullptr) {
+      return reinterpret_cast<T*>(std::allocator<Unit>().allocate(units));
+    }
+    return static_cast<T*>(pool->allocate(sizeof(T)));
+  }
+  void deallocate(T* ptr, size_t count) {
+    if (!pooled(count)) {
+      std::allocator<T>().deallocate(ptr, count);
+      return;
+    }
+    Pool* pool = Pool::local();
+    if (pool == nullptr) {
+      std::allocator<Unit>().deallocate(reinterpret_cast<Unit*>(ptr), units);
+      return;
+    }
+    pool->deallocate(ptr, sizeof(T));
+  }
+
+  template <typename U>
+  bool operator==(const LocalPoolAllocator<U>& /*another*/) const {
+    return true;
+  }
+  template <typename U>
+  bool operator!=(const LocalPoolAllocator<U>& /*another*/) const {
+    return false;
+  }
+};
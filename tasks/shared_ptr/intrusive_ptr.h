@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+#include "shared_ptr.h"
+
+// Base that keeps the reference count inside the object for IntrusivePtr.
+// Count is AtomicCount or LocalCount; LocalRefCounted is the
+// single-threaded variant. The object deletes itself with its last
+// reference. BiasedCount does not fit: it reaches zero on its owner
+// thread's queue, outside of release.
+template <typename Derived, typename Count = AtomicCount>
+class RefCounted {
+  static_assert(std::is_same_v<Count, AtomicCount> ||
+                    std::is_same_v<Count, LocalCount>,
+                "RefCounted takes AtomicCount or LocalCount");
+
+ private:
+  mutable Count count_{0};
+
+  friend void retain(const Derived* ptr) {
+    static_cast<const RefCounted*>(ptr)->count_.increment();
+  }
+  friend void release(const Derived* ptr) {
+    if (static_cast<const RefCounted*>(ptr)->count_.decrement()) {
+      delete ptr;
+    }
+  }
+
+ protected:
+  RefCounted() = default;
+  // A copy is a new object, nobody refers to it yet.
+  RefCounted(const RefCounted& /*another*/) {
+  }
+  RefCounted& operator=(const RefCounted& /*another*/) {
+    return *this;
+  }
+  ~RefCounted() = default;
+
+ public:
+  size_t ref_count() const {
+    return count_.load();
+  }
+};
+
+template <typename Derived>
+using LocalRefCounted = RefCounted<Derived, LocalCount>;
+
+// Pointer to an object that counts its own references: retain(T*) and
+// release(T*) are found by argument-dependent lookup, RefCounted provides
+// both. There is no control block and the pointer is one word, so a raw
+// pointer converts back into an owning one at any time.
+template <typename T>
+class IntrusivePtr {
+ private:
+  T* ptr_ = nullptr;
+
+  template <typename U>
+  friend class IntrusivePtr;
+
+ public:
+  using element_type = T;
+
+  IntrusivePtr() = default;
+  IntrusivePtr(std::nullptr_t) {
+  }
+  // With add_ref == false the pointer takes over a reference the caller
+  // holds, e.g. one given away by detach().
+  IntrusivePtr(T* ptr, bool add_ref = true)
+      : ptr_(ptr) {
+    if (ptr_ != nullptr && add_ref) {
+      retain(ptr_);
+    }
+  }
+
+  IntrusivePtr(const IntrusivePtr& another)
+      : IntrusivePtr(another.ptr_) {
+  }
+  template <typename U>
+    requires std::is_convertible_v<U*, T*>
+  IntrusivePtr(const IntrusivePtr<U>& another)
+      : IntrusivePtr(another.ptr_) {
+  }
+  IntrusivePtr(IntrusivePtr&& another) noexcept
+      : ptr_(std::exchange(another.ptr_, nullptr)) {
+  }
+  template <typename U>
+    requires std::is_convertible_v<U*, T*>
+  IntrusivePtr(IntrusivePtr<U>&& another) noexcept
+      : ptr_(std::exchange(another.ptr_, nullptr)) {
+  }
+
+  IntrusivePtr& operator=(const IntrusivePtr& another) {
+    IntrusivePtr(another).swap(*this);
+    return *this;
+  }
+  IntrusivePtr& operator=(IntrusivePtr&& another) noexcept {
+    IntrusivePtr(std::move(another)).swap(*this);
+    return *this;
+  }
+  IntrusivePtr& operator=(T* ptr) {
+    IntrusivePtr(ptr).swap(*this);
+    return *this;
+  }
+
+  ~IntrusivePtr() {
+    if (ptr_ != nullptr) {
+      release(ptr_);
+    }
+  }
+
+  T* get() const {
+    return ptr_;
+  }
+  T& operator*() const {
+    return *ptr_;
+  }
+  T* operator->() const {
+    return ptr_;
+  }
+  explicit operator bool() const {
+    return ptr_ != nullptr;
+  }
+
+  // Gives up ownership without releasing: the caller now holds the
+  // reference.
+  T* detach() {
+    return std::exchange(ptr_, nullptr);
+  }
+
+  void reset() {
+    IntrusivePtr().swap(*this);
+  }
+  void reset(T* ptr, bool add_ref = true) {
+    IntrusivePtr(ptr, add_ref).swap(*this);
+  }
+
+  void swap(IntrusivePtr& another) noexcept {
+    std::swap(ptr_, another.ptr_);
+  }
+};
+
+template <typename T, typename U>
+bool operator==(const IntrusivePtr<T>& lhs, const IntrusivePtr<U>& rhs) {
+  return lhs.get() == rhs.get();
+}
+template <typename T>
+bool operator==(const IntrusivePtr<T>& lhs, std::nullptr_t) {
+  return lhs.get() == nullptr;
+}
+
+template <typename T, typename... Args>
+IntrusivePtr<T> make_intrusive(Args&&... args) {
+  return IntrusivePtr<T>(new T(std::forward<Args>(args)...));
+}
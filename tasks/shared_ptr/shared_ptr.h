@@ -0,0 +1,675 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "control_block_pool.h"
+
+// Reference count policies. AtomicCount is safe to share between threads,
+// LocalCount is a plain integer for pointers that never leave the thread
+// that created them (see LocalSharedPtr).
+//
+// A new reference is always made from an existing one, which already keeps
+// the object alive, so increments need no ordering. The decrement that
+// reaches zero must see every write made through the other references
+// before the object is destroyed: each decrement releases, and the last
+// one acquires.
+class AtomicCount {
+ private:
+  std::atomic<size_t> value_;
+
+ public:
+  using weak_count_type = AtomicCount;
+
+  explicit AtomicCount(size_t value)
+      : value_(value) {
+  }
+
+  void increment() {
+    value_.fetch_add(1, std::memory_order_relaxed);
+  }
+  // True if the count dropped to zero.
+  bool decrement() {
+    if (value_.fetch_sub(1, std::memory_order_release) == 1) {
+      // synchronizes with every earlier decrement, unlike a fence this is
+      // understood by ThreadSanitizer
+      value_.load(std::memory_order_acquire);
+      return true;
+    }
+    return false;
+  }
+  // Increments unless the count is already zero.
+  bool try_increment() {
+    size_t count = value_.load(std::memory_order_relaxed);
+    while (count != 0) {
+      if (value_.compare_exchange_weak(count, count + 1,
+                                       std::memory_order_relaxed)) {
+        return true;
+      }
+    }
+    return false;
+  }
+  size_t load() const {
+    return value_.load(std::memory_order_relaxed);
+  }
+};
+
+class LocalCount {
+ private:
+  size_t value_;
+
+ public:
+  using weak_count_type = LocalCount;
+
+  explicit LocalCount(size_t value)
+      : value_(value) {
+  }
+
+  void increment() {
+    ++value_;
+  }
+  bool decrement() {
+    return --value_ == 0;
+  }
+  bool try_increment() {
+    if (value_ == 0) {
+      return false;
+    }
+    ++value_;
+    return true;
+  }
+  size_t load() const {
+    return value_;
+  }
+};
+
+// Counts shared between all SharedPtr and WeakPtr to one object. The
+// owners together hold one weak reference, so the block dies when the
+// weak count drops to zero and never while an owner still looks at it.
+// A policy whose count can reach zero outside decrement (BiasedCount)
+// calls back through set_zero_handler.
+template <typename Count>
+struct BaseControlBlock {
+  Count shared_count{1};
+  typename Count::weak_count_type weak_count{1};
+
+  static void last_owner_gone(void* block) {
+    auto* self = static_cast<BaseControlBlock*>(block);
+    self->destroy_object();
+    self->release_weak();
+  }
+
+  BaseControlBlock() {
+    if constexpr (requires { shared_count.set_zero_handler(nullptr, this); }) {
+      shared_count.set_zero_handler(&last_owner_gone, this);
+    }
+  }
+  BaseControlBlock(const BaseControlBlock&) = delete;
+  BaseControlBlock& operator=(const BaseControlBlock&) = delete;
+  virtual ~BaseControlBlock() = default;
+
+  // Called when the last owner goes away.
+  virtual void destroy_object() = 0;
+  // Called when the last weak reference goes away, frees the block itself.
+  virtual void deallocate_block() = 0;
+
+  void retain_shared() {
+    shared_count.increment();
+  }
+  void release_shared() {
+    if (shared_count.decrement()) {
+      destroy_object();
+      release_weak();
+    }
+  }
+  void retain_weak() {
+    weak_count.increment();
+  }
+  void release_weak() {
+    if (weak_count.decrement()) {
+      deallocate_block();
+    }
+  }
+  // WeakPtr::lock: takes a shared reference unless the object is gone.
+  bool try_retain_shared() {
+    return shared_count.try_increment();
+  }
+};
+
+// Control block for an object allocated elsewhere, destroyed by Deleter.
+template <typename Y, typename Deleter, typename Alloc, typename Count>
+struct ControlBlockRegular : BaseControlBlock<Count> {
+  using BlockAlloc = typename std::allocator_traits<
+      Alloc>::template rebind_alloc<ControlBlockRegular>;
+  using BlockTraits = std::allocator_traits<BlockAlloc>;
+
+  Y* ptr;
+  [[no_unique_address]] Deleter deleter;
+  [[no_unique_address]] BlockAlloc alloc;
+
+  ControlBlockRegular(Y* ptr, Deleter deleter, const Alloc& alloc)
+      : ptr(ptr),
+        deleter(std::move(deleter)),
+        alloc(alloc) {
+  }
+
+  void destroy_object() override {
+    deleter(ptr);
+  }
+  void deallocate_block() override {
+    BlockAlloc block_alloc = std::move(alloc);
+    auto self =
+        std::pointer_traits<typename BlockTraits::pointer>::pointer_to(*this);
+    this->~ControlBlockRegular();
+    BlockTraits::deallocate(block_alloc, self, 1);
+  }
+};
+
+// Control block of makeShared and allocateShared, the object lives inside.
+template <typename T, typename Alloc, typename Count>
+struct ControlBlockMakeShared : BaseControlBlock<Count> {
+  using ValueAlloc =
+      typename std::allocator_traits<Alloc>::template rebind_alloc<T>;
+  using ValueTraits = std::allocator_traits<ValueAlloc>;
+  using BlockAlloc = typename std::allocator_traits<
+      Alloc>::template rebind_alloc<ControlBlockMakeShared>;
+  using BlockTraits = std::allocator_traits<BlockAlloc>;
+
+  alignas(T) char storage[sizeof(T)];
+  [[no_unique_address]] ValueAlloc alloc;
+
+  template <typename... Args>
+  ControlBlockMakeShared(const Alloc& alloc, Args&&... args)
+      : alloc(alloc) {
+    ValueTraits::construct(this->alloc, object(), std::forward<Args>(args)...);
+  }
+
+  T* object() {
+    return std::launder(reinterpret_cast<T*>(storage));
+  }
+
+  void destroy_object() override {
+    ValueTraits::destroy(alloc, object());
+  }
+  void deallocate_block() override {
+    BlockAlloc block_alloc = std::move(alloc);
+    auto self =
+        std::pointer_traits<typename BlockTraits::pointer>::pointer_to(*this);
+    this->~ControlBlockMakeShared();
+    BlockTraits::deallocate(block_alloc, self, 1);
+  }
+};
+
+// Element storage of ControlBlockArray, aligned for the block and the
+// elements alike.
+template <typename... Types>
+struct alignas(Types...) AlignedUnit {
+  unsigned char byte;
+};
+
+// Control block of makeShared<T[]>(n): the n elements follow the block in
+// the same allocation and are constructed and destroyed through the
+// allocator, the last one first.
+template <typename E, typename Alloc, typename Count>
+struct ControlBlockArray : BaseControlBlock<Count> {
+  using ValueAlloc =
+      typename std::allocator_traits<Alloc>::template rebind_alloc<E>;
+  using ValueTraits = std::allocator_traits<ValueAlloc>;
+  using Unit = AlignedUnit<ControlBlockArray, E>;
+  using UnitAlloc =
+      typename std::allocator_traits<Alloc>::template rebind_alloc<Unit>;
+  using UnitTraits = std::allocator_traits<UnitAlloc>;
+
+  size_t size;
+  [[no_unique_address]] ValueAlloc alloc;
+
+  ControlBlockArray(const Alloc& alloc, size_t size)
+      : size(size),
+        alloc(alloc) {
+  }
+
+  static size_t elements_offset() {
+    return (sizeof(ControlBlockArray) + alignof(E) - 1) / alignof(E) *
+           alignof(E);
+  }
+  static size_t units(size_t size) {
+    return (elements_offset() + size * sizeof(E) + sizeof(Unit) - 1) /
+           sizeof(Unit);
+  }
+
+  // Constructs every element from values..., which is empty or a single
+  // value to copy.
+  template <typename... Values>
+  static ControlBlockArray* create(const Alloc& alloc, size_t size,
+                                   const Values&... values);
+
+  E* elements() {
+    return std::launder(reinterpret_cast<E*>(
+        reinterpret_cast<unsigned char*>(this) + elements_offset()));
+  }
+
+  void destroy_object() override {
+    E* first = elements();
+    for (size_t i = size; i > 0; --i) {
+      ValueTraits::destroy(alloc, first + i - 1);
+    }
+  }
+  void deallocate_block() override {
+    UnitAlloc unit_alloc(std::move(alloc));
+    size_t count = units(size);
+    auto self = std::pointer_traits<typename UnitTraits::pointer>::pointer_to(
+        *reinterpret_cast<Unit*>(this));
+    this->~ControlBlockArray();
+    UnitTraits::deallocate(unit_alloc, self, count);
+  }
+};
+
+template <typename E, typename Alloc, typename Count>
+template <typename... Values>
+ControlBlockArray<E, Alloc, Count>* ControlBlockArray<E, Alloc, Count>::create(
+    const Alloc& alloc, size_t size, const Values&... values) {
+  UnitAlloc unit_alloc(alloc);
+  size_t count = units(size);
+  auto memory = UnitTraits::allocate(unit_alloc, count);
+  auto* block = new (std::to_address(memory)) ControlBlockArray(alloc, size);
+  auto* first = reinterpret_cast<E*>(reinterpret_cast<unsigned char*>(block) +
+                                     elements_offset());
+  size_t constructed = 0;
+  try {
+    for (; constructed < size; ++constructed) {
+      ValueTraits::construct(block->alloc, first + constructed, values...);
+    }
+  } catch (...) {
+    for (; constructed > 0; --constructed) {
+      ValueTraits::destroy(block->alloc, first + constructed - 1);
+    }
+    block->~ControlBlockArray();
+    UnitTraits::deallocate(unit_alloc, memory, count);
+    throw;
+  }
+  return block;
+}
+
+// SharedPtr<T> may adopt a Y*: Y* converts to T*, or for T = U[] Y(*)[]
+// does.
+template <typename Y, typename T>
+concept AdoptablePointer =
+    (std::is_unbounded_array_v<T> && std::is_convertible_v<Y (*)[], T*>) ||
+    (!std::is_array_v<T> && std::is_convertible_v<Y*, T*>);
+
+template <typename T, typename Count = AtomicCount>
+class SharedPtr;
+template <typename T, typename Count = AtomicCount>
+class WeakPtr;
+
+template <typename T>
+class AtomicSharedPtr;
+
+template <typename T, typename Count = AtomicCount, typename Alloc,
+          typename... Args>
+// NOLINTNEXTLINE(readability-identifier-naming)
+SharedPtr<T, Count> allocateShared(const Alloc& alloc, Args&&... args);
+
+// T may be an array of unknown bound U[]: the pointer then owns an array
+// of U, deletes it with delete[] and offers operator[].
+template <typename T, typename Count>
+class SharedPtr {
+ public:
+  using element_type = std::remove_extent_t<T>;
+
+ private:
+  using ControlBlock = BaseControlBlock<Count>;
+
+  element_type* ptr_ = nullptr;
+  ControlBlock* block_ = nullptr;
+
+  template <typename U, typename C>
+  friend class SharedPtr;
+  template <typename U, typename C>
+  friend class WeakPtr;
+  template <typename U>
+  friend class AtomicSharedPtr;
+  template <typename U, typename C, typename Alloc, typename... Args>
+  // NOLINTNEXTLINE(readability-identifier-naming)
+  friend SharedPtr<U, C> allocateShared(const Alloc& alloc, Args&&... args);
+
+  // Adopts a reference that the caller already holds.
+  SharedPtr(ControlBlock* block, element_type* ptr)
+      : ptr_(ptr),
+        block_(block) {
+  }
+
+ public:
+  using weak_type = WeakPtr<T, Count>;
+
+  SharedPtr() = default;
+  SharedPtr(std::nullptr_t) {
+  }
+
+  template <typename Y>
+    requires AdoptablePointer<Y, T>
+  explicit SharedPtr(Y* ptr)
+      : SharedPtr(ptr, std::conditional_t<std::is_array_v<T>,
+                                          std::default_delete<Y[]>,
+                                          std::default_delete<Y>>()) {
+  }
+  // The control block comes from the pool of the calling thread.
+  template <typename Y, typename Deleter>
+    requires AdoptablePointer<Y, T>
+  SharedPtr(Y* ptr, Deleter deleter)
+      : SharedPtr(ptr, std::move(deleter), LocalPoolAllocator<Y>()) {
+  }
+  // The control block comes from alloc. If it cannot be allocated,
+  // deleter(ptr) is called and the exception propagates.
+  template <typename Y, typename Deleter, typename Alloc>
+    requires AdoptablePointer<Y, T>
+  SharedPtr(Y* ptr, Deleter deleter, Alloc alloc);
+
+  // Aliasing: shares ownership with owner but points to ptr, usually a
+  // member or a sub-range of the owned object. Nothing is copied and ptr
+  // is never deleted by itself.
+  template <typename Y>
+  SharedPtr(const SharedPtr<Y, Count>& owner, element_type* ptr) noexcept
+      : SharedPtr(owner.block_, ptr) {
+    if (block_ != nullptr) {
+      block_->retain_shared();
+    }
+  }
+  template <typename Y>
+  SharedPtr(SharedPtr<Y, Count>&& owner, element_type* ptr) noexcept
+      : SharedPtr(std::exchange(owner.block_, nullptr), ptr) {
+    owner.ptr_ = nullptr;
+  }
+
+  SharedPtr(const SharedPtr& another) noexcept
+      : SharedPtr(another.block_, another.ptr_) {
+    if (block_ != nullptr) {
+      block_->retain_shared();
+    }
+  }
+  template <typename Y>
+    requires std::is_convertible_v<Y*, T*>
+  SharedPtr(const SharedPtr<Y, Count>& another) noexcept
+      : SharedPtr(another.block_, another.ptr_) {
+    if (block_ != nullptr) {
+      block_->retain_shared();
+    }
+  }
+  SharedPtr(SharedPtr&& another) noexcept
+      : SharedPtr(std::exchange(another.block_, nullptr),
+                  std::exchange(another.ptr_, nullptr)) {
+  }
+  template <typename Y>
+    requires std::is_convertible_v<Y*, T*>
+  SharedPtr(SharedPtr<Y, Count>&& another) noexcept
+      : SharedPtr(std::exchange(another.block_, nullptr),
+                  std::exchange(another.ptr_, nullptr)) {
+  }
+  // Throws std::bad_weak_ptr if the object is already gone.
+  template <typename Y>
+    requires std::is_convertible_v<Y*, T*>
+  explicit SharedPtr(const WeakPtr<Y, Count>& another);
+
+  SharedPtr& operator=(const SharedPtr& another) noexcept {
+    SharedPtr(another).swap(*this);
+    return *this;
+  }
+  template <typename Y>
+  SharedPtr& operator=(const SharedPtr<Y, Count>& another) noexcept {
+    SharedPtr(another).swap(*this);
+    return *this;
+  }
+  SharedPtr& operator=(SharedPtr&& another) noexcept {
+    SharedPtr(std::move(another)).swap(*this);
+    return *this;
+  }
+  template <typename Y>
+  SharedPtr& operator=(SharedPtr<Y, Count>&& another) noexcept {
+    SharedPtr(std::move(another)).swap(*this);
+    return *this;
+  }
+
+  ~SharedPtr() {
+    if (block_ != nullptr) {
+      block_->release_shared();
+    }
+  }
+
+  size_t use_count() const {
+    return block_ == nullptr ? 0 : block_->shared_count.load();
+  }
+  element_type* get() const {
+    return ptr_;
+  }
+  element_type& operator*() const
+    requires(!std::is_array_v<T>)
+  {
+    return *ptr_;
+  }
+  element_type* operator->() const
+    requires(!std::is_array_v<T>)
+  {
+    return ptr_;
+  }
+  element_type& operator[](ptrdiff_t index) const
+    requires std::is_array_v<T>
+  {
+    return ptr_[index];
+  }
+  explicit operator bool() const {
+    return ptr_ != nullptr;
+  }
+
+  void reset() noexcept {
+    SharedPtr().swap(*this);
+  }
+  template <typename Y>
+  void reset(Y* ptr) {
+    SharedPtr(ptr).swap(*this);
+  }
+  template <typename Y, typename Deleter>
+  void reset(Y* ptr, Deleter deleter) {
+    SharedPtr(ptr, std::move(deleter)).swap(*this);
+  }
+  template <typename Y, typename Deleter, typename Alloc>
+  void reset(Y* ptr, Deleter deleter, Alloc alloc) {
+    SharedPtr(ptr, std::move(deleter), std::move(alloc)).swap(*this);
+  }
+
+  void swap(SharedPtr& another) noexcept {
+    std::swap(ptr_, another.ptr_);
+    std::swap(block_, another.block_);
+  }
+};
+
+template <typename T, typename Count>
+template <typename Y, typename Deleter, typename Alloc>
+  requires AdoptablePointer<Y, T>
+SharedPtr<T, Count>::SharedPtr(Y* ptr, Deleter deleter, Alloc alloc)
+    : ptr_(ptr) {
+  using Block = ControlBlockRegular<Y, Deleter, Alloc, Count>;
+  typename Block::BlockAlloc block_alloc(alloc);
+  Block* block = nullptr;
+  try {
+    block = std::to_address(Block::BlockTraits::allocate(block_alloc, 1));
+  } catch (...) {
+    deleter(ptr);
+    throw;
+  }
+  block_ = new (block) Block(ptr, std::move(deleter), alloc);
+}
+
+template <typename T, typename Count>
+template <typename Y>
+  requires std::is_convertible_v<Y*, T*>
+SharedPtr<T, Count>::SharedPtr(const WeakPtr<Y, Count>& another) {
+  if (another.block_ == nullptr || !another.block_->try_retain_shared()) {
+    throw std::bad_weak_ptr();
+  }
+  ptr_ = another.ptr_;
+  block_ = another.block_;
+}
+
+template <typename T, typename U, typename Count>
+bool operator==(const SharedPtr<T, Count>& lhs,
+                const SharedPtr<U, Count>& rhs) {
+  return lhs.get() == rhs.get();
+}
+template <typename T, typename Count>
+bool operator==(const SharedPtr<T, Count>& lhs, std::nullptr_t) {
+  return lhs.get() == nullptr;
+}
+
+template <typename T, typename Count>
+class WeakPtr {
+ public:
+  using element_type = std::remove_extent_t<T>;
+
+ private:
+  using ControlBlock = BaseControlBlock<Count>;
+
+  element_type* ptr_ = nullptr;
+  ControlBlock* block_ = nullptr;
+
+  template <typename U, typename C>
+  friend class WeakPtr;
+  template <typename U, typename C>
+  friend class SharedPtr;
+
+  WeakPtr(ControlBlock* block, element_type* ptr)
+      : ptr_(ptr),
+        block_(block) {
+    if (block_ != nullptr) {
+      block_->retain_weak();
+    }
+  }
+
+ public:
+  WeakPtr() = default;
+  template <typename Y>
+    requires std::is_convertible_v<Y*, T*>
+  WeakPtr(const SharedPtr<Y, Count>& shared) noexcept
+      : WeakPtr(shared.block_, shared.ptr_) {
+  }
+  WeakPtr(const WeakPtr& another) noexcept
+      : WeakPtr(another.block_, another.ptr_) {
+  }
+  template <typename Y>
+    requires std::is_convertible_v<Y*, T*>
+  WeakPtr(const WeakPtr<Y, Count>& another) noexcept
+      : WeakPtr(another.block_, another.ptr_) {
+  }
+  WeakPtr(WeakPtr&& another) noexcept
+      : ptr_(std::exchange(another.ptr_, nullptr)),
+        block_(std::exchange(another.block_, nullptr)) {
+  }
+  template <typename Y>
+    requires std::is_convertible_v<Y*, T*>
+  WeakPtr(WeakPtr<Y, Count>&& another) noexcept
+      : ptr_(std::exchange(another.ptr_, nullptr)),
+        block_(std::exchange(another.block_, nullptr)) {
+  }
+
+  WeakPtr& operator=(const WeakPtr& another) noexcept {
+    WeakPtr(another).swap(*this);
+    return *this;
+  }
+  template <typename Y>
+  WeakPtr& operator=(const WeakPtr<Y, Count>& another) noexcept {
+    WeakPtr(another).swap(*this);
+    return *this;
+  }
+  template <typename Y>
+  WeakPtr& operator=(const SharedPtr<Y, Count>& shared) noexcept {
+    WeakPtr(shared).swap(*this);
+    return *this;
+  }
+  WeakPtr& operator=(WeakPtr&& another) noexcept {
+    WeakPtr(std::move(another)).swap(*this);
+    return *this;
+  }
+  template <typename Y>
+  WeakPtr& operator=(WeakPtr<Y, Count>&& another) noexcept {
+    WeakPtr(std::move(another)).swap(*this);
+    return *this;
+  }
+
+  ~WeakPtr() {
+    if (block_ != nullptr) {
+      block_->release_weak();
+    }
+  }
+
+  size_t use_count() const {
+    return block_ == nullptr ? 0 : block_->shared_count.load();
+  }
+  bool expired() const {
+    return use_count() == 0;
+  }
+  // Empty if the object is already gone, never throws.
+  SharedPtr<T, Count> lock() const {
+    if (block_ == nullptr || !block_->try_retain_shared()) {
+      return SharedPtr<T, Count>();
+    }
+    return SharedPtr<T, Count>(block_, ptr_);
+  }
+
+  void reset() noexcept {
+    WeakPtr().swap(*this);
+  }
+  void swap(WeakPtr& another) noexcept {
+    std::swap(ptr_, another.ptr_);
+    std::swap(block_, another.block_);
+  }
+};
+
+// Control block and object in one allocation from alloc. The object is
+// constructed and destroyed through the allocator, as with
+// std::allocate_shared. For T = U[] the arguments are the number of
+// elements and optionally a value to copy into each, otherwise they are
+// value-initialized.
+template <typename T, typename Count, typename Alloc, typename... Args>
+// NOLINTNEXTLINE(readability-identifier-naming)
+SharedPtr<T, Count> allocateShared(const Alloc& alloc, Args&&... args) {
+  if constexpr (std::is_unbounded_array_v<T>) {
+    using Block = ControlBlockArray<std::remove_extent_t<T>, Alloc, Count>;
+    Block* block = Block::create(alloc, std::forward<Args>(args)...);
+    return SharedPtr<T, Count>(block, block->elements());
+  } else {
+    using Block = ControlBlockMakeShared<T, Alloc, Count>;
+    typename Block::BlockAlloc block_alloc(alloc);
+    auto memory = Block::BlockTraits::allocate(block_alloc, 1);
+    Block* block = nullptr;
+    try {
+      block = new (std::to_address(memory))
+          Block(alloc, std::forward<Args>(args)...);
+    } catch (...) {
+      Block::BlockTraits::deallocate(block_alloc, memory, 1);
+      throw;
+    }
+    return SharedPtr<T, Count>(block, block->object());
+  }
+}
+
+template <typename T, typename Count = AtomicCount, typename... Args>
+// NOLINTNEXTLINE(readability-identifier-naming)
+SharedPtr<T, Count> makeShared(Args&&... args) {
+  return allocateShared<T, Count>(std::allocator<std::remove_extent_t<T>>(),
+                                  std::forward<Args>(args)...);
+}
+
+// Pointers whose counts are never touched by two threads: copies cost a
+// plain increment instead of a locked read-modify-write.
+template <typename T>
+using LocalSharedPtr = SharedPtr<T, LocalCount>;
+template <typename T>
+using LocalWeakPtr = WeakPtr<T, LocalCount>;
+
+template <typename T, typename... Args>
+LocalSharedPtr<T> make_local_shared(Args&&... args) {
+  return makeShared<T, LocalCount>(std::forward<Args>(args)...);
+}
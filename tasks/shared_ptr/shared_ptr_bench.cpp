@@ -0,0 +1,459 @@
+// Timing harness for SharedPtr and WeakPtr against std::shared_ptr and
+// std::weak_ptr. Correctness lives in shared_ptr_test.cpp; this binary
+// only measures.
+//
+//   shared_ptr_bench [--warmup N] [--repetitions M] [--operations K]
+//                    [--threads T] [--filter SUBSTRING] [--json PATH]
+//
+// Every workload reports nanoseconds and heap allocations per operation,
+// the latter as a median over the measured repetitions.
+// Contended copies run on 1, 2, 4, ... up to T threads that all copy the
+// same pointer. A table goes to stderr, JSON to stdout or PATH.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../list/stackallocator.h"
+#include "shared_ptr.h"
+
+namespace {
+
+std::atomic<size_t> heap_allocations = 0;
+
+}  // namespace
+
+void* operator new(size_t bytes) {
+  heap_allocations.fetch_add(1, std::memory_order_relaxed);
+  void* ptr = std::malloc(bytes == 0 ? 1 : bytes);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t /*bytes*/) noexcept {
+  std::free(ptr);
+}
+
+namespace {
+
+const size_t arena_size = 1'000'000;
+
+using Arena = StackStorage<arena_size>;
+
+struct Options {
+  int warmup = 1;
+  int repetitions = 5;
+  size_t operations = 1'000'000;
+  int threads = static_cast<int>(
+      std::max(4u, std::min(16u, std::thread::hardware_concurrency())));
+  std::string filter;
+  std::string json;
+};
+
+struct Own {
+  static constexpr const char* name = "SharedPtr";
+
+  template <typename T>
+  using Shared = SharedPtr<T>;
+  template <typename T>
+  using Weak = WeakPtr<T>;
+
+  template <typename T, typename... Args>
+  static Shared<T> make(Args&&... args) {
+    return makeShared<T>(std::forward<Args>(args)...);
+  }
+  template <typename T, typename Alloc, typename... Args>
+  static Shared<T> allocate(const Alloc& alloc, Args&&... args) {
+    return allocateShared<T>(alloc, std::forward<Args>(args)...);
+  }
+};
+
+struct Standard {
+  static constexpr const char* name = "std::shared_ptr";
+
+  template <typename T>
+  using Shared = std::shared_ptr<T>;
+  template <typename T>
+  using Weak = std::weak_ptr<T>;
+
+  template <typename T, typename... Args>
+  static Shared<T> make(Args&&... args) {
+    return std::make_shared<T>(std::forward<Args>(args)...);
+  }
+  template <typename T, typename Alloc, typename... Args>
+  static Shared<T> allocate(const Alloc& alloc, Args&&... args) {
+    return std::allocate_shared<T>(alloc, std::forward<Args>(args)...);
+  }
+};
+
+// Times the region between start and stop and counts the heap
+// allocations made in it.
+class Stopwatch {
+ private:
+  std::chrono::steady_clock::time_point start_;
+  std::chrono::steady_clock::time_point finish_;
+  size_t allocations_before_ = 0;
+  size_t allocations_ = 0;
+
+ public:
+  void start() {
+    allocations_before_ = heap_allocations.load(std::memory_order_relaxed);
+    start_ = std::chrono::steady_clock::now();
+  }
+  void stop() {
+    finish_ = std::chrono::steady_clock::now();
+    allocations_ =
+        heap_allocations.load(std::memory_order_relaxed) - allocations_before_;
+  }
+
+  double nanos() const {
+    return std::chrono::duration<double, std::nano>(finish_ - start_).count();
+  }
+  size_t allocations() const {
+    return allocations_;
+  }
+};
+
+// A workload runs count operations and times only the hot loop. run
+// returns a checksum so that the work cannot be optimized out.
+struct ConstructNew {
+  static constexpr const char* name = "construct_new";
+
+  template <typename Pointers>
+  static size_t run(Stopwatch& watch, size_t count) {
+    size_t sum = 0;
+    watch.start();
+    for (size_t i = 0; i < count; ++i) {
+      typename Pointers::template Shared<size_t> sp(new size_t(i));
+      sum += *sp;
+    }
+    watch.stop();
+    return sum;
+  }
+};
+
+struct MakeShared {
+  static constexpr const char* name = "make_shared";
+
+  template <typename Pointers>
+  static size_t run(Stopwatch& watch, size_t count) {
+    size_t sum = 0;
+    watch.start();
+    for (size_t i = 0; i < count; ++i) {
+      auto sp = Pointers::template make<size_t>(i);
+      sum += *sp;
+    }
+    watch.stop();
+    return sum;
+  }
+};
+
+struct AllocateShared {
+  static constexpr const char* name = "allocate_shared";
+
+  // Every pointer dies before the next one is made, so the arena only
+  // ever holds one block.
+  template <typename Pointers>
+  static size_t run(Stopwatch& watch, size_t count) {
+    std::unique_ptr<Arena> arena(new Arena);
+    StackAllocator<size_t, arena_size> alloc(*arena);
+    size_t sum = 0;
+    watch.start();
+    for (size_t i = 0; i < count; ++i) {
+      auto sp = Pointers::template allocate<size_t>(alloc, i);
+      sum += *sp;
+    }
+    watch.stop();
+    return sum;
+  }
+};
+
+struct Copy {
+  static constexpr const char* name = "copy";
+
+  // A copy constructed and destroyed. Assigning over another copy of the
+  // same object would let std::shared_ptr skip the counts.
+  template <typename Pointers>
+  static size_t run(Stopwatch& watch, size_t count) {
+    auto source = Pointers::template make<size_t>(1);
+    size_t sum = 0;
+    watch.start();
+    for (size_t i = 0; i < count; ++i) {
+      typename Pointers::template Shared<size_t> copy = source;
+      sum += *copy;
+    }
+    watch.stop();
+    return sum;
+  }
+};
+
+struct Move {
+  static constexpr const char* name = "move";
+
+  template <typename Pointers>
+  static size_t run(Stopwatch& watch, size_t count) {
+    typename Pointers::template Shared<size_t> slots[2] = {
+        Pointers::template make<size_t>(1), nullptr};
+    watch.start();
+    for (size_t i = 0; i < count; ++i) {
+      slots[(i + 1) % 2] = std::move(slots[i % 2]);
+    }
+    watch.stop();
+    return *slots[count % 2];
+  }
+};
+
+struct Destroy {
+  static constexpr const char* name = "destroy";
+
+  template <typename Pointers>
+  static size_t run(Stopwatch& watch, size_t count) {
+    auto source = Pointers::template make<size_t>(1);
+    std::vector<typename Pointers::template Shared<size_t>> copies(count,
+                                                                   source);
+    watch.start();
+    for (auto& copy : copies) {
+      copy = nullptr;
+    }
+    watch.stop();
+    return source.use_count();
+  }
+};
+
+struct WeakLock {
+  static constexpr const char* name = "weak_lock";
+
+  template <typename Pointers>
+  static size_t run(Stopwatch& watch, size_t count) {
+    auto source = Pointers::template make<size_t>(1);
+    typename Pointers::template Weak<size_t> weak = source;
+    size_t sum = 0;
+    watch.start();
+    for (size_t i = 0; i < count; ++i) {
+      sum += *weak.lock();
+    }
+    watch.stop();
+    return sum;
+  }
+};
+
+struct Sample {
+  double nanos_per_operation;
+  double allocations_per_operation;
+};
+
+struct Result {
+  std::string pointer;
+  std::string workload;
+  std::vector<Sample> samples;
+
+  // Nearest-rank percentile of the measured times.
+  double percentile(double fraction) const;
+  // Median of the allocations per operation over the measured runs.
+  double median_allocations() const;
+};
+
+double Result::percentile(double fraction) const {
+  std::vector<double> times;
+  times.reserve(samples.size());
+  for (const auto& sample : samples) {
+    times.push_back(sample.nanos_per_operation);
+  }
+  if (times.empty()) {
+    return 0;
+  }
+  std::sort(times.begin(), times.end());
+  auto rank =
+      static_cast<size_t>(fraction * static_cast<double>(times.size()));
+  return times[std::min(rank, times.size() - 1)];
+}
+
+double Result::median_allocations() const {
+  std::vector<double> allocations;
+  allocations.reserve(samples.size());
+  for (const auto& sample : samples) {
+    allocations.push_back(sample.allocations_per_operation);
+  }
+  if (allocations.empty()) {
+    return 0;
+  }
+  std::sort(allocations.begin(), allocations.end());
+  return allocations[allocations.size() / 2];
+}
+
+size_t volatile sink = 0;
+
+// All threads copy the same pointer, count copies each. The time per
+// operation is the wall time divided by count, so perfect scaling keeps
+// it flat.
+template <typename Pointers>
+size_t run_contended(Stopwatch& watch, size_t count, int threads) {
+  auto source = Pointers::template make<size_t>(1);
+  std::atomic<int> ready = 0;
+  std::atomic<bool> go = false;
+  std::atomic<size_t> total = 0;
+  std::vector<std::thread> workers;
+  for (int i = 0; i < threads; ++i) {
+    workers.emplace_back([&source, &ready, &go, &total, count] {
+      ready.fetch_add(1);
+      while (!go.load()) {
+        std::this_thread::yield();
+      }
+      size_t sum = 0;
+      for (size_t j = 0; j < count; ++j) {
+        typename Pointers::template Shared<size_t> copy = source;
+        sum += *copy;
+      }
+      total.fetch_add(sum);
+    });
+  }
+  while (ready.load() != threads) {
+    std::this_thread::yield();
+  }
+  watch.start();
+  go.store(true);
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  watch.stop();
+  return total.load();
+}
+
+void report(const Result& result) {
+  std::cerr << "  " << result.pointer << " / " << result.workload << ": min "
+            << result.percentile(0.0) << " ns/op, median "
+            << result.percentile(0.5) << " ns/op, p99 "
+            << result.percentile(0.99) << " ns/op, allocations/op "
+            << result.median_allocations() << std::endl;
+}
+
+template <typename Pointers, typename Run>
+void measure(const std::string& workload, const Options& options, Run run,
+             std::vector<Result>& results) {
+  std::string tag = std::string(Pointers::name) + "/" + workload;
+  if (tag.find(options.filter) == std::string::npos) {
+    return;
+  }
+
+  Result result{Pointers::name, workload, {}};
+  for (int i = 0; i < options.warmup + options.repetitions; ++i) {
+    Stopwatch watch;
+    sink = sink + run(watch, options.operations);
+    auto count = static_cast<double>(options.operations);
+    if (i >= options.warmup) {
+      result.samples.push_back(
+          {watch.nanos() / count,
+           static_cast<double>(watch.allocations()) / count});
+    }
+  }
+  report(result);
+  results.push_back(std::move(result));
+}
+
+template <typename Workload>
+void measure_both(const Options& options, std::vector<Result>& results) {
+  measure<Own>(Workload::name, options, Workload::template run<Own>,
+               results);
+  measure<Standard>(Workload::name, options, Workload::template run<Standard>,
+                    results);
+}
+
+template <typename Pointers>
+void measure_contended(const Options& options, std::vector<Result>& results) {
+  for (int threads = 1; threads <= options.threads; threads *= 2) {
+    measure<Pointers>(
+        "contended_copy/" + std::to_string(threads), options,
+        [threads](Stopwatch& watch, size_t count) {
+          return run_contended<Pointers>(watch, count, threads);
+        },
+        results);
+  }
+}
+
+void write_json(std::ostream& out, const Options& options,
+                const std::vector<Result>& results) {
+  out << "{\n  \"operations\": " << options.operations
+      << ",\n  \"warmup\": " << options.warmup
+      << ",\n  \"repetitions\": " << options.repetitions
+      << ",\n  \"results\": [";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result& result = results[i];
+    out << (i == 0 ? "\n" : ",\n") << "    {\"pointer\": \""
+        << result.pointer << "\", \"workload\": \"" << result.workload
+        << "\", \"min_ns_per_op\": " << result.percentile(0.0)
+        << ", \"median_ns_per_op\": " << result.percentile(0.5)
+        << ", \"p99_ns_per_op\": " << result.percentile(0.99)
+        << ", \"allocations_per_op\": " << result.median_allocations()
+        << "}";
+  }
+  out << "\n  ]\n}\n";
+}
+
+Options parse_options(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; i += 2) {
+    std::string key = argv[i];
+    if (i + 1 == argc) {
+      throw std::invalid_argument("option " + key + " expects a value");
+    }
+    std::string value = argv[i + 1];
+    if (key == "--warmup") {
+      options.warmup = std::stoi(value);
+    } else if (key == "--repetitions") {
+      options.repetitions = std::max(1, std::stoi(value));
+    } else if (key == "--operations") {
+      options.operations = std::max<size_t>(1, std::stoul(value));
+    } else if (key == "--threads") {
+      options.threads = std::max(1, std::stoi(value));
+    } else if (key == "--filter") {
+      options.filter = value;
+    } else if (key == "--json") {
+      options.json = value;
+    } else {
+      throw std::invalid_argument("unknown option " + key);
+    }
+  }
+  return options;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options = parse_options(argc, argv);
+  // libstdc++ counts without atomics until the process starts a thread;
+  // real users of both pointers are multi-threaded
+  std::thread([] {}).join();
+
+  std::vector<Result> results;
+  measure_both<ConstructNew>(options, results);
+  measure_both<MakeShared>(options, results);
+  measure_both<AllocateShared>(options, results);
+  measure_both<Copy>(options, results);
+  measure_both<Move>(options, results);
+  measure_both<Destroy>(options, results);
+  measure_both<WeakLock>(options, results);
+  measure_contended<Own>(options, results);
+  measure_contended<Standard>(options, results);
+
+  if (options.json.empty()) {
+    write_json(std::cout, options, results);
+  } else {
+    std::ofstream out(options.json);
+    write_json(out, options, results);
+  }
+}
@@ -0,0 +1,973 @@
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "shared_ptr.h"
+#include "intrusive_ptr.h"
+#include "biased_count.h"
+#include "atomic_shared_ptr.h"
+#include "control_block_pool.h"
+#include "../list/stackallocator.h"
+
+#ifndef NO_TEST
+
+// NOLINTBEGIN
+
+std::atomic<size_t> new_calls = 0;
+
+void* operator new(size_t bytes) {
+    ++new_calls;
+    void* ptr = std::malloc(bytes == 0 ? 1 : bytes);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+struct Accountant {
+    static int ctor_calls;
+    static int dtor_calls;
+
+    int value = 0;
+
+    Accountant() {
+        ++ctor_calls;
+    }
+    Accountant(int value) : value(value) {
+        ++ctor_calls;
+    }
+    Accountant(const Accountant& another) : value(another.value) {
+        ++ctor_calls;
+    }
+    virtual ~Accountant() {
+        ++dtor_calls;
+    }
+
+    static void reset() {
+        ctor_calls = dtor_calls = 0;
+    }
+};
+
+int Accountant::ctor_calls = 0;
+int Accountant::dtor_calls = 0;
+
+struct Derived: public Accountant {
+    std::string name;
+
+    Derived(int value, std::string name) : Accountant(value), name(std::move(name)) {}
+};
+
+void TestOwnership() {
+    Accountant::reset();
+    {
+        SharedPtr<Accountant> sp(new Accountant(5));
+        assert(sp.use_count() == 1 && sp->value == 5);
+
+        SharedPtr<Accountant> copy = sp;
+        assert(sp.use_count() == 2 && copy.get() == sp.get());
+
+        SharedPtr<Accountant> moved = std::move(copy);
+        assert(!copy && copy.use_count() == 0 && sp.use_count() == 2);
+
+        moved = sp;
+        assert(sp.use_count() == 2);
+        moved.reset();
+        assert(sp.use_count() == 1 && !moved);
+
+        sp.reset(new Accountant(7));
+        assert(Accountant::dtor_calls == 1 && sp->value == 7);
+
+        SharedPtr<Accountant> empty;
+        SharedPtr<Accountant> null = nullptr;
+        assert(empty.use_count() == 0 && null == nullptr);
+        empty = sp;
+        sp.swap(null);
+        assert(!sp && null.use_count() == 2);
+    }
+    assert(Accountant::ctor_calls == 2 && Accountant::dtor_calls == 2);
+
+    Accountant::reset();
+    {
+        SharedPtr<Derived> derived = makeShared<Derived>(3, "three");
+        SharedPtr<Accountant> base = derived;
+        assert(base.use_count() == 2 && base->value == 3);
+        SharedPtr<Accountant> moved_base = std::move(derived);
+        assert(base.use_count() == 2 && !derived);
+
+        // deleting through the pointer the SharedPtr was created with
+        SharedPtr<Accountant> adopted(new Derived(4, "four"));
+        assert(static_cast<Derived&>(*adopted).name == "four");
+    }
+    assert(Accountant::ctor_calls == 2 && Accountant::dtor_calls == 2);
+}
+
+void TestWeakPtr() {
+    Accountant::reset();
+
+    WeakPtr<Accountant> weak;
+    assert(weak.expired() && !weak.lock());
+    {
+        auto sp = makeShared<Accountant>(1);
+        weak = sp;
+        assert(!weak.expired() && weak.use_count() == 1);
+
+        WeakPtr<Accountant> copy = weak;
+        auto locked = copy.lock();
+        assert(locked.get() == sp.get() && sp.use_count() == 2);
+
+        SharedPtr<Accountant> strong(weak);
+        assert(sp.use_count() == 3);
+    }
+    assert(weak.expired() && !weak.lock());
+    assert(Accountant::dtor_calls == 1);
+
+    bool thrown = false;
+    try {
+        SharedPtr<Accountant> strong(weak);
+    } catch (const std::bad_weak_ptr&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    // the object dies with the last owner, the block with the last WeakPtr
+    SharedPtr<Accountant> sp(new Accountant(2));
+    WeakPtr<Accountant> other = sp;
+    sp.reset();
+    assert(Accountant::dtor_calls == 2 && other.expired());
+    other.reset();
+}
+
+void TestDeleterAndAllocator() {
+    int deleted = 0;
+    {
+        SharedPtr<int> sp(new int(5), [&deleted](int* ptr) {
+            ++deleted;
+            delete ptr;
+        });
+        auto copy = sp;
+    }
+    assert(deleted == 1);
+
+    StackStorage<10'000, StackStats> storage;
+    StackAllocator<int, 10'000, StackStats> alloc(storage);
+    {
+        int value = 8;
+        SharedPtr<int> sp(&value, [](int*) {}, alloc);
+        assert(storage.stats().allocations == 1 && *sp == 8);
+    }
+    assert(storage.stats().bytes_in_use == 0);
+
+    size_t before = new_calls;
+    {
+        auto sp = allocateShared<Accountant>(alloc, 11);
+        WeakPtr<Accountant> weak = sp;
+        assert(sp->value == 11 && new_calls == before);
+        assert(storage.stats().allocations == 2);
+    }
+    assert(storage.stats().bytes_in_use == 0 && new_calls == before);
+}
+
+void TestSingleAllocation() {
+    size_t before = new_calls;
+    {
+        auto sp = makeShared<Accountant>(1);
+        assert(new_calls == before + 1);
+        auto copy = sp;
+        WeakPtr<Accountant> weak = copy;
+        assert(new_calls == before + 1);
+    }
+
+    // the control block is recycled from the pool of the thread
+    SharedPtr<Accountant>(new Accountant(0)).reset();
+    before = new_calls;
+    {
+        SharedPtr<Accountant> sp(new Accountant(1));
+        assert(new_calls == before + 1);
+    }
+}
+
+void TestThreads() {
+    auto sp = makeShared<Accountant>(42);
+    WeakPtr<Accountant> weak = sp;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([sp, weak]() {
+            for (int j = 0; j < 100'000; ++j) {
+                SharedPtr<Accountant> copy = sp;
+                auto locked = weak.lock();
+                assert(locked->value == 42);
+            }
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+    assert(sp.use_count() == 1);
+}
+
+void TestLocalSharedPtr() {
+    Accountant::reset();
+    LocalWeakPtr<Accountant> weak;
+    {
+        LocalSharedPtr<Accountant> sp = make_local_shared<Derived>(1, "one");
+        weak = sp;
+        auto copy = sp;
+        assert(sp.use_count() == 2 && weak.lock()->value == 1);
+
+        LocalSharedPtr<Accountant> adopted(new Accountant(2));
+        adopted = std::move(copy);
+        assert(Accountant::dtor_calls == 1 && sp.use_count() == 2);
+
+        StackStorage<10'000> storage;
+        StackAllocator<int, 10'000> alloc(storage);
+        auto in_arena = allocateShared<Accountant, LocalCount>(alloc, 3);
+        assert(in_arena->value == 3);
+    }
+    assert(weak.expired() && Accountant::ctor_calls == Accountant::dtor_calls);
+
+    static_assert(!std::is_convertible_v<LocalSharedPtr<int>, SharedPtr<int>>);
+    static_assert(sizeof(LocalSharedPtr<int>) == sizeof(SharedPtr<int>));
+}
+
+struct Node: public RefCounted<Node> {
+    static int alive;
+
+    int value;
+    IntrusivePtr<Node> next;
+
+    Node(int value) : value(value) {
+        ++alive;
+    }
+    virtual ~Node() {
+        --alive;
+    }
+};
+
+int Node::alive = 0;
+
+struct LeafNode: public Node {
+    using Node::Node;
+};
+
+struct LocalNode: public LocalRefCounted<LocalNode> {
+    int value = 0;
+};
+
+// A type with its own counting scheme, plugged in through retain/release.
+struct Handle {
+    int refs = 0;
+    bool closed = false;
+};
+
+void retain(Handle* handle) {
+    ++handle->refs;
+}
+
+void release(Handle* handle) {
+    if (--handle->refs == 0) {
+        handle->closed = true;
+    }
+}
+
+void TestIntrusivePtr() {
+    static_assert(sizeof(IntrusivePtr<Node>) == sizeof(Node*));
+    {
+        auto head = make_intrusive<Node>(1);
+        head->next = make_intrusive<LeafNode>(2);
+        head->next->next = new Node(3);
+        assert(head->ref_count() == 1 && head->next->ref_count() == 1);
+
+        IntrusivePtr<Node> second = head->next;
+        assert(second->ref_count() == 2 && Node::alive == 3);
+
+        // back and forth through a raw pointer keeps the count right
+        Node* raw = second.get();
+        IntrusivePtr<Node> again = raw;
+        assert(raw->ref_count() == 3);
+
+        Node* detached = again.detach();
+        assert(!again && detached->ref_count() == 3);
+        IntrusivePtr<Node> adopted(detached, false);
+        assert(adopted->ref_count() == 3);
+
+        head.reset();
+        assert(Node::alive == 2 && second->ref_count() == 2);
+        adopted = nullptr;
+        second = std::move(second->next);
+        assert(Node::alive == 1 && second->value == 3);
+
+        IntrusivePtr<LeafNode> leaf(new LeafNode(4));
+        IntrusivePtr<Node> base = leaf;
+        assert(base == leaf && leaf->ref_count() == 2);
+    }
+    assert(Node::alive == 0);
+
+    {
+        IntrusivePtr<LocalNode> local(new LocalNode());
+        auto copy = local;
+        assert(local->ref_count() == 2);
+        LocalNode copied_value = *local;
+        assert(copied_value.ref_count() == 0);
+    }
+
+    Handle handle;
+    {
+        IntrusivePtr<Handle> first(&handle);
+        IntrusivePtr<Handle> second = first;
+        assert(handle.refs == 2);
+    }
+    assert(handle.closed && handle.refs == 0);
+}
+
+struct Counted {
+    static std::atomic<int> alive;
+
+    int value;
+
+    Counted(int value) : value(value) {
+        ++alive;
+    }
+    ~Counted() {
+        --alive;
+    }
+};
+
+std::atomic<int> Counted::alive = 0;
+
+void TestBiasedCount() {
+    {
+        auto sp = make_biased_shared<Counted>(1);
+        BiasedWeakPtr<Counted> weak = sp;
+        auto copy = sp;
+        assert(sp.use_count() == 2 && weak.lock()->value == 1);
+        copy.reset();
+        sp.reset();
+        assert(weak.expired() && Counted::alive == 0);
+    }
+
+    // a reference moved away and dropped by another thread
+    {
+        auto sp = make_biased_shared<Counted>(2);
+        BiasedWeakPtr<Counted> weak = sp;
+        std::thread([moved = std::move(sp)]() mutable {
+            assert(moved->value == 2);
+            moved.reset();
+        }).join();
+        assert(Counted::alive == 1);
+        // dead but not merged yet: another thread must not revive it
+        std::thread([&weak]() {
+            assert(weak.expired() && !weak.lock());
+        }).join();
+
+        // the owner merges the queued count at its next count operation
+        auto other = make_biased_shared<Counted>(3);
+        auto copy = other;
+        assert(Counted::alive == 1);
+    }
+    assert(Counted::alive == 0);
+
+    // the owner thread finishes before the other references are dropped
+    {
+        BiasedSharedPtr<Counted> kept;
+        BiasedWeakPtr<Counted> weak;
+        std::thread([&kept, &weak]() {
+            auto sp = make_biased_shared<Counted>(4);
+            kept = sp;
+            weak = sp;
+        }).join();
+        assert(kept.use_count() == 1 && weak.lock()->value == 4);
+        auto copy = kept;
+        kept.reset();
+        copy.reset();
+        assert(Counted::alive == 0 && weak.expired());
+    }
+
+    // a thread-local object that outlives the owner record drops and
+    // makes counts while its thread finishes
+    {
+        struct LateUser {
+            BiasedSharedPtr<Counted> kept;
+
+            ~LateUser() {
+                kept.reset();
+                auto late = make_biased_shared<Counted>(7);
+                auto copy = late;
+            }
+        };
+        std::thread([]() {
+            thread_local LateUser user;
+            user.kept = make_biased_shared<Counted>(6);
+        }).join();
+        assert(Counted::alive == 0);
+    }
+
+    // owner and other threads copy and drop the same object concurrently
+    {
+        auto sp = make_biased_shared<Counted>(5);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 4; ++i) {
+            threads.emplace_back([copy = sp]() mutable {
+                for (int j = 0; j < 50'000; ++j) {
+                    BiasedSharedPtr<Counted> local = copy;
+                    BiasedWeakPtr<Counted> weak = local;
+                    assert(weak.lock()->value == 5);
+                }
+                copy.reset();
+            });
+        }
+        for (int j = 0; j < 50'000; ++j) {
+            BiasedSharedPtr<Counted> local = sp;
+        }
+        sp.reset();
+        for (auto& thread: threads) {
+            thread.join();
+        }
+        BiasedCount::merge_pending();
+        assert(Counted::alive == 0);
+    }
+}
+
+void TestAtomicSharedPtr() {
+    {
+        AtomicSharedPtr<Counted> atomic;
+        assert(atomic.is_lock_free() && !atomic.load());
+
+        auto first = makeShared<Counted>(1);
+        atomic.store(first);
+        assert(first.use_count() == 2 && atomic.load() == first);
+
+        auto old = atomic.exchange(makeShared<Counted>(2));
+        assert(old == first && atomic.load()->value == 2);
+
+        SharedPtr<Counted> expected = first;
+        assert(!atomic.compare_exchange_strong(expected, makeShared<Counted>(3)));
+        assert(expected->value == 2 && Counted::alive == 2);
+        assert(atomic.compare_exchange_strong(expected, nullptr));
+        expected.reset();
+        assert(!atomic.load() && Counted::alive == 1);
+
+        SharedPtr<Counted> none;
+        assert(atomic.compare_exchange_weak(none, makeShared<Counted>(4)));
+        SharedPtr<Counted> loaded = atomic;
+        assert(loaded->value == 4);
+    }
+    assert(Counted::alive == 0);
+
+    // one writer publishes snapshots, readers never see them go back
+    {
+        AtomicSharedPtr<Counted> atomic(makeShared<Counted>(0));
+        std::atomic<bool> done = false;
+        std::vector<std::thread> readers;
+        for (int i = 0; i < 3; ++i) {
+            readers.emplace_back([&atomic, &done]() {
+                int last = 0;
+                while (!done) {
+                    auto snapshot = atomic.load();
+                    assert(snapshot->value >= last);
+                    last = snapshot->value;
+                }
+            });
+        }
+        for (int i = 1; i <= 20'000; ++i) {
+            atomic.store(makeShared<Counted>(i));
+        }
+        done = true;
+        for (auto& thread: readers) {
+            thread.join();
+        }
+        assert(atomic.load()->value == 20'000 && Counted::alive == 1);
+    }
+    assert(Counted::alive == 0);
+
+    // concurrent read-modify-write through compare_exchange
+    {
+        AtomicSharedPtr<Counted> atomic(makeShared<Counted>(0));
+        std::vector<std::thread> writers;
+        for (int i = 0; i < 4; ++i) {
+            writers.emplace_back([&atomic]() {
+                for (int j = 0; j < 5'000; ++j) {
+                    auto expected = atomic.load();
+                    while (!atomic.compare_exchange_weak(expected, makeShared<Counted>(expected->value + 1))) {
+                    }
+                }
+            });
+        }
+        for (auto& thread: writers) {
+            thread.join();
+        }
+        assert(atomic.load()->value == 20'000 && Counted::alive == 1);
+    }
+    assert(Counted::alive == 0);
+}
+
+void TestControlBlockPool() {
+    ControlBlockPool<>* pool = ControlBlockPool<>::local();
+    SharedPtr<int>(new int(0)).reset();
+    size_t before = new_calls;
+    size_t upstream_before = pool->upstream_allocations();
+    for (int i = 0; i < 1'000; ++i) {
+        SharedPtr<int> sp(new int(i));
+        auto copy = sp;
+    }
+    assert(new_calls == before + 1'000 && pool->upstream_allocations() == upstream_before);
+
+    // the block of an expired pointer goes back when the last WeakPtr does
+    {
+        size_t free_before = pool->free_blocks();
+        WeakPtr<int> weak;
+        {
+            SharedPtr<int> sp(new int(1));
+            weak = sp;
+        }
+        assert(weak.expired() && pool->free_blocks() == free_before - 1);
+        weak.reset();
+        assert(pool->free_blocks() == free_before);
+    }
+
+    // blocks released by another thread join that thread's pool
+    {
+        SharedPtr<int> sp(new int(2));
+        std::thread([moved = std::move(sp)]() mutable {
+            moved.reset();
+            assert(ControlBlockPool<>::local()->free_blocks() == 1);
+        }).join();
+    }
+
+    // an explicit pool carved out of a StackStorage
+    StackStorage<10'000, StackStats> storage;
+    using ArenaPool = ControlBlockPool<StackAllocator<std::byte, 10'000, StackStats>>;
+    {
+        ArenaPool arena_pool{StackAllocator<std::byte, 10'000, StackStats>(storage)};
+        PoolAllocator<int, ArenaPool> alloc(arena_pool);
+        int value = 3;
+        before = new_calls;
+        for (int i = 0; i < 1'000; ++i) {
+            SharedPtr<int> sp(&value, [](int*) {}, alloc);
+            WeakPtr<int> weak = sp;
+            assert(*sp == 3);
+        }
+        assert(new_calls == before);
+        assert(storage.stats().allocations == 1 && arena_pool.upstream_allocations() == 1);
+        assert(arena_pool.free_blocks() == 1);
+    }
+    assert(storage.stats().bytes_in_use == 0);
+}
+
+struct ThrowingOnThird {
+    static int constructed;
+
+    ThrowingOnThird() {
+        if (constructed == 2) {
+            throw std::runtime_error("third");
+        }
+        ++constructed;
+    }
+    ~ThrowingOnThird() {
+        --constructed;
+    }
+};
+
+int ThrowingOnThird::constructed = 0;
+
+struct alignas(64) Wide {
+    double value = 1;
+};
+
+void TestArraysAndAliasing() {
+    size_t before = new_calls;
+    {
+        auto buffer = makeShared<int[]>(5);
+        assert(new_calls == before + 1);
+        for (int i = 0; i < 5; ++i) {
+            assert(buffer[i] == 0);
+            buffer[i] = i;
+        }
+        SharedPtr<int[]> copy = buffer;
+        WeakPtr<int[]> weak = copy;
+        assert(buffer.use_count() == 2 && weak.lock()[4] == 4);
+    }
+
+    Accountant::reset();
+    {
+        auto accountants = makeShared<Accountant[]>(3, Accountant(7));
+        assert(accountants[2].value == 7 && Accountant::ctor_calls == 4 && Accountant::dtor_calls == 1);
+    }
+    assert(Accountant::dtor_calls == 4);
+
+    // elements constructed before the exception are destroyed again
+    try {
+        makeShared<ThrowingOnThird[]>(5);
+        assert(false);
+    } catch (const std::runtime_error&) {
+        assert(ThrowingOnThird::constructed == 0);
+    }
+
+    {
+        auto wide = makeShared<Wide[]>(3);
+        for (int i = 0; i < 3; ++i) {
+            assert(reinterpret_cast<uintptr_t>(&wide[i]) % 64 == 0 && wide[i].value == 1);
+        }
+        SharedPtr<int[]> adopted(new int[10]());
+        assert(adopted[9] == 0);
+    }
+
+    StackStorage<10'000, StackStats> storage;
+    StackAllocator<double, 10'000, StackStats> alloc(storage);
+    {
+        auto buffer = allocateShared<double[]>(alloc, 100, 0.5);
+        assert(buffer[99] == 0.5 && storage.stats().allocations == 1);
+    }
+    assert(storage.stats().bytes_in_use == 0);
+
+    // slices and members keep the whole object alive
+    {
+        auto buffer = makeShared<double[]>(100);
+        buffer[10] = 3;
+        SharedPtr<double[]> slice(buffer, buffer.get() + 10);
+        SharedPtr<double[]> moved_slice(SharedPtr<double[]>(buffer), buffer.get() + 20);
+        buffer.reset();
+        assert(slice[0] == 3 && slice.use_count() == 2);
+        moved_slice.reset();
+        assert(slice.use_count() == 1);
+
+        auto accountant = makeShared<Accountant>(5);
+        SharedPtr<int> member(accountant, &accountant->value);
+        accountant.reset();
+        assert(*member == 5 && member.use_count() == 1);
+    }
+}
+
+template <typename Pointer>
+long long MeasureThreadedCopies(const std::vector<Pointer>& pointers, int copies) {
+    using namespace std::chrono;
+
+    auto start = high_resolution_clock::now();
+    std::vector<std::thread> threads;
+    for (const Pointer& sp: pointers) {
+        threads.emplace_back([&sp, copies]() {
+            std::vector<Pointer> local(64);
+            for (int i = 0; i < copies; ++i) {
+                local[i % 64] = sp;
+            }
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+    auto finish = high_resolution_clock::now();
+    return duration_cast<milliseconds>(finish - start).count();
+}
+
+// With own objects every thread copies pointers it created, with one
+// object all threads copy a pointer created by the main thread.
+void CompareBiasedScaling() {
+    const int copies = 2'000'000;
+    int max_threads = std::max(4u, std::min(16u, std::thread::hardware_concurrency()));
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        std::vector<SharedPtr<int>> own_atomic;
+        for (int i = 0; i < threads; ++i) {
+            own_atomic.push_back(makeShared<int>(1));
+        }
+        auto own_atomic_time = MeasureThreadedCopies(own_atomic, copies);
+
+        // biased pointers are owned by the thread that makes them
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<std::thread> makers;
+        for (int i = 0; i < threads; ++i) {
+            makers.emplace_back([copies]() {
+                auto sp = make_biased_shared<int>(1);
+                std::vector<BiasedSharedPtr<int>> local(64);
+                for (int j = 0; j < copies; ++j) {
+                    local[j % 64] = sp;
+                }
+            });
+        }
+        for (auto& thread: makers) {
+            thread.join();
+        }
+        auto finish = std::chrono::high_resolution_clock::now();
+        auto own_biased_time = std::chrono::duration_cast<std::chrono::milliseconds>(finish - start).count();
+
+        auto shared_atomic = makeShared<int>(1);
+        auto shared_biased = make_biased_shared<int>(1);
+        auto one_atomic = MeasureThreadedCopies(std::vector<SharedPtr<int>>(threads, shared_atomic), copies);
+        auto one_biased = MeasureThreadedCopies(std::vector<BiasedSharedPtr<int>>(threads, shared_biased), copies);
+
+        std::cerr << " " << threads << " threads x 2M copies: own objects " << own_atomic_time << " ms atomic, "
+                << own_biased_time << " ms biased; one object " << one_atomic << " ms atomic, " << one_biased
+                << " ms biased" << std::endl;
+    }
+}
+
+// Readers load the current snapshot while one writer keeps replacing it.
+template <typename Load, typename Store>
+long long MeasurePublication(int readers, Load load, Store store) {
+    using namespace std::chrono;
+
+    std::atomic<bool> done = false;
+    std::thread writer([&done, &store]() {
+        for (int i = 0; !done; ++i) {
+            store(makeShared<int>(i));
+            std::this_thread::yield();
+        }
+    });
+    auto start = high_resolution_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < readers; ++i) {
+        threads.emplace_back([&load]() {
+            for (int j = 0; j < 1'000'000; ++j) {
+                SharedPtr<int> snapshot = load();
+                assert(snapshot);
+            }
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+    auto finish = high_resolution_clock::now();
+    done = true;
+    writer.join();
+    return duration_cast<milliseconds>(finish - start).count();
+}
+
+void ComparePublication() {
+    int max_readers = std::max(4u, std::min(16u, std::thread::hardware_concurrency()));
+    for (int readers = 1; readers <= max_readers; readers *= 2) {
+        AtomicSharedPtr<int> atomic(makeShared<int>(0));
+        auto lock_free = MeasurePublication(readers, [&atomic] { return atomic.load(); },
+                [&atomic](SharedPtr<int> value) { atomic.store(std::move(value)); });
+
+        std::mutex mutex;
+        SharedPtr<int> current = makeShared<int>(0);
+        auto locked = MeasurePublication(readers,
+                [&] {
+                    std::lock_guard lock(mutex);
+                    return current;
+                },
+                [&](SharedPtr<int> value) {
+                    std::lock_guard lock(mutex);
+                    current.swap(value);
+                });
+
+        std::cerr << " 1 writer, " << readers << " readers x 1M loads: AtomicSharedPtr " << lock_free
+                << " ms, mutex and SharedPtr " << locked << " ms" << std::endl;
+    }
+}
+
+template <typename Pointer>
+long long MeasureCopies(const Pointer& sp) {
+    using namespace std::chrono;
+
+    std::vector<Pointer> copies(64);
+    auto start = high_resolution_clock::now();
+    for (int i = 0; i < 10'000'000; ++i) {
+        copies[i % 64] = sp;
+    }
+    copies.clear();
+    auto finish = high_resolution_clock::now();
+    assert(sp);
+    return duration_cast<milliseconds>(finish - start).count();
+}
+
+void CompareCountPolicies() {
+    auto atomic = MeasureCopies(makeShared<int>(1));
+    auto local = MeasureCopies(make_local_shared<int>(1));
+    auto standard = MeasureCopies(std::make_shared<int>(1));
+    auto intrusive = MeasureCopies(make_intrusive<Node>(1));
+    auto intrusive_local = MeasureCopies(make_intrusive<LocalNode>());
+
+    std::cerr << " 10M copies and destructions: SharedPtr " << atomic << " ms, LocalSharedPtr "
+            << local << " ms, std::shared_ptr " << standard << " ms, IntrusivePtr " << intrusive
+            << " ms, IntrusivePtr to LocalRefCounted " << intrusive_local << " ms" << std::endl;
+}
+
+template <typename Make>
+long long MeasureCreation(Make make) {
+    using namespace std::chrono;
+
+    std::vector<decltype(make(0))> pointers;
+    pointers.reserve(1'000'000);
+    auto start = high_resolution_clock::now();
+    for (int i = 0; i < 1'000'000; ++i) {
+        pointers.push_back(make(i));
+    }
+    pointers.clear();
+    auto finish = high_resolution_clock::now();
+    return duration_cast<milliseconds>(finish - start).count();
+}
+
+void CompareCreationPerformance() {
+    size_t before = new_calls;
+    auto with_new = MeasureCreation([](int i) { return SharedPtr<int>(new int(i)); });
+    size_t new_allocations = new_calls - before;
+
+    before = new_calls;
+    auto with_make = MeasureCreation([](int i) { return makeShared<int>(i); });
+    size_t make_allocations = new_calls - before;
+
+    auto with_std = MeasureCreation([](int i) { return std::make_shared<int>(i); });
+
+    auto storage = std::make_unique<StackStorage<100'000'000>>();
+    StackAllocator<int, 100'000'000> alloc(*storage);
+    auto with_stack = MeasureCreation([&alloc](int i) { return allocateShared<int>(alloc, i); });
+
+    std::cerr << " 1M pointers: SharedPtr(new T) " << with_new << " ms (" << new_allocations
+            << " allocations), makeShared " << with_make << " ms (" << make_allocations
+            << " allocations), std::make_shared " << with_std << " ms, allocateShared with StackAllocator "
+            << with_stack << " ms" << std::endl;
+}
+
+// Pointers adopted, copied and dropped in a steady state: only the
+// control block is allocated.
+template <typename Make>
+long long MeasureAdoption(Make make) {
+    using namespace std::chrono;
+
+    std::vector<SharedPtr<int>> live(64);
+    auto start = high_resolution_clock::now();
+    for (int i = 0; i < 2'000'000; ++i) {
+        live[i % 64] = make();
+        WeakPtr<int> weak = live[i % 64];
+    }
+    live.clear();
+    auto finish = high_resolution_clock::now();
+    return duration_cast<milliseconds>(finish - start).count();
+}
+
+void CompareControlBlockPool() {
+    static int value = 0;
+    auto noop = [](int*) {};
+
+    size_t before = new_calls;
+    auto pooled = MeasureAdoption([noop] { return SharedPtr<int>(&value, noop); });
+    size_t pooled_allocations = new_calls - before;
+
+    before = new_calls;
+    auto with_std = MeasureAdoption([noop] { return SharedPtr<int>(&value, noop, std::allocator<int>()); });
+    size_t std_allocations = new_calls - before;
+
+    std::cerr << " 2M adopted pointers: pooled control blocks " << pooled << " ms (" << pooled_allocations
+            << " allocations), std::allocator " << with_std << " ms (" << std_allocations << " allocations)"
+            << std::endl;
+}
+
+// Every stage gets a 1000-element window of a shared buffer: copied out
+// into a vector, or as a SharedPtr aliasing the buffer.
+void CompareSlicing() {
+    using namespace std::chrono;
+
+    const int size = 1'000'000;
+    const int window = 1'000;
+    auto buffer = makeShared<double[]>(size, 1.0);
+    double sum = 0;
+
+    size_t before = new_calls;
+    auto start = high_resolution_clock::now();
+    for (int i = 0; i + window <= size; i += 100) {
+        std::vector<double> slice(buffer.get() + i, buffer.get() + i + window);
+        sum += slice[window - 1];
+    }
+    auto copy_time = duration_cast<milliseconds>(high_resolution_clock::now() - start).count();
+    size_t copy_allocations = new_calls - before;
+
+    before = new_calls;
+    start = high_resolution_clock::now();
+    for (int i = 0; i + window <= size; i += 100) {
+        SharedPtr<double[]> slice(buffer, buffer.get() + i);
+        sum += slice[window - 1];
+    }
+    auto alias_time = duration_cast<milliseconds>(high_resolution_clock::now() - start).count();
+    size_t alias_allocations = new_calls - before;
+
+    assert(sum > 0);
+    std::cerr << " 10K windows of 1000 doubles: copied into vectors " << copy_time << " ms (" << copy_allocations
+            << " allocations), aliasing SharedPtr " << alias_time << " ms (" << alias_allocations
+            << " allocations)" << std::endl;
+}
+
+int main() {
+    TestOwnership();
+
+    std::cerr << "Test 1 (ownership) passed." << std::endl;
+
+    TestWeakPtr();
+
+    std::cerr << "Test 2 (WeakPtr) passed." << std::endl;
+
+    TestDeleterAndAllocator();
+
+    std::cerr << "Test 3 (deleter and allocator) passed." << std::endl;
+
+    TestSingleAllocation();
+
+    std::cerr << "Test 4 (makeShared allocates once) passed." << std::endl;
+
+    TestThreads();
+
+    std::cerr << "Test 5 (threads) passed." << std::endl;
+
+    TestLocalSharedPtr();
+
+    std::cerr << "Test 6 (LocalSharedPtr) passed." << std::endl;
+
+    TestIntrusivePtr();
+
+    std::cerr << "Test 7 (IntrusivePtr) passed." << std::endl;
+
+    TestBiasedCount();
+
+    std::cerr << "Test 8 (biased reference counting) passed." << std::endl;
+
+    TestAtomicSharedPtr();
+
+    std::cerr << "Test 9 (AtomicSharedPtr) passed." << std::endl;
+
+    TestControlBlockPool();
+
+    std::cerr << "Test 10 (pooled control blocks) passed." << std::endl;
+
+    TestArraysAndAliasing();
+
+    std::cerr << "Test 11 (arrays and aliasing) passed." << std::endl;
+
+    CompareCreationPerformance();
+    CompareControlBlockPool();
+    CompareSlicing();
+    CompareCountPolicies();
+    CompareBiasedScaling();
+    ComparePublication();
+
+    std::cerr << "Tests passed!" << std::endl;
+
+    std::cout << 0;
+}
+
+// NOLINTEND
+
+#else
+
+int main() {
+    std::cerr << "Tests are turned off!\n";
+}
+
+#endif
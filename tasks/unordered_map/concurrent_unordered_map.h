@@ -0,0 +1,262 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "unordered_map.h"
+
+// Hash map for many threads: the keys are spread over a power-of-two
+// number of shards, each an UnorderedMap behind its own reader/writer
+// lock, so threads that touch different shards never wait for each
+// other. A shard is picked by the high bits of the mixed hash, the map
+// inside buckets by the low ones.
+//
+// There are no iterators: values are read by copy (find) or inside a
+// callback that runs under the shard lock (visit, cvisit, for_each). A
+// callback must not call back into the same map.
+template <typename Key, typename Value, typename Hash = std::hash<Key>,
+          typename Equal = std::equal_to<Key>,
+          typename Alloc = std::allocator<std::pair<const Key, Value>>>
+class ConcurrentUnorderedMap {
+ public:
+  using key_type = Key;
+  using mapped_type = Value;
+  using value_type = std::pair<const Key, Value>;
+  using hasher = Hash;
+  using key_equal = Equal;
+  using allocator_type = Alloc;
+  using Map = UnorderedMap<Key, Value, Hash, Equal, Alloc>;
+
+  static const size_t default_shard_count = 64;
+
+ private:
+  static const size_t cache_line = 64;
+
+  // The lock and the map start on separate cache lines, and no two shards
+  // share one.
+  struct alignas(cache_line) Shard {
+    mutable std::shared_mutex mutex;
+    alignas(cache_line) Map map;
+
+    Shard(const Hash& hash, const Equal& equal, const Alloc& alloc)
+        : map(0, hash, equal, alloc) {
+    }
+  };
+
+  [[no_unique_address]] Hash hash_;
+  std::allocator<Shard> shard_alloc_;
+  Shard* shards_;
+  size_t shard_count_;
+  int shard_shift_;
+
+  // The key is hashed once: the shard maps share Hash and take the same
+  // hash through their *_hashed members.
+  Shard& shard_of(size_t hash) const {
+    // the multiplication carries every bit of the hash into the top ones
+    auto mixed = static_cast<uint64_t>(hash) * 0x9E3779B97F4A7C15ULL;
+    return shards_[shard_count_ == 1 ? 0 : mixed >> shard_shift_];
+  }
+
+ public:
+  explicit ConcurrentUnorderedMap(size_t shard_count = default_shard_count,
+                                  const Hash& hash = Hash(),
+                                  const Equal& equal = Equal(),
+                                  const Alloc& alloc = Alloc());
+  ConcurrentUnorderedMap(const ConcurrentUnorderedMap&) = delete;
+  ConcurrentUnorderedMap& operator=(const ConcurrentUnorderedMap&) = delete;
+  ~ConcurrentUnorderedMap();
+
+  size_t shard_count() const {
+    return shard_count_;
+  }
+  // Each shard is counted under its own lock: concurrent updates make the
+  // total approximate.
+  size_t size() const;
+  bool empty() const {
+    return size() == 0;
+  }
+  void clear();
+
+  std::optional<Value> find(const Key& key) const;
+  bool contains(const Key& key) const {
+    return cvisit(key, [](const Value& /*value*/) {});
+  }
+  // Returns true if the key was inserted, false if it was assigned.
+  template <typename V>
+  bool insert_or_assign(const Key& key, V&& value);
+  size_t erase(const Key& key);
+
+  // Calls fn with the value of key under an exclusive lock, for updates
+  // in place. Returns false if there is no such key.
+  template <typename Fn>
+  bool visit(const Key& key, Fn fn);
+  // As visit, with a const value under a shared lock.
+  template <typename Fn>
+  bool cvisit(const Key& key, Fn fn) const;
+
+  // Calls fn(const value_type&) for every element, spreading the shards
+  // over threads; each shard is read under its shared lock. fn must be
+  // safe to call from several threads at once.
+  template <typename Fn>
+  void for_each(Fn fn,
+                size_t threads = std::thread::hardware_concurrency()) const;
+};
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+ConcurrentUnorderedMap<Key, Value, Hash, Equal, Alloc>::ConcurrentUnorderedMap(
+    size_t shard_count, const Hash& hash, const Equal& equal,
+    const Alloc& alloc)
+    : hash_(hash),
+      shard_count_(std::bit_ceil(std::max<size_t>(shard_count, 1))),
+      shard_shift_(64 - std::countr_zero(shard_count_)) {
+  shards_ = shard_alloc_.allocate(shard_count_);
+  size_t built = 0;
+  try {
+    for (; built < shard_count_; ++built) {
+      std::construct_at(shards_ + built, hash, equal, alloc);
+    }
+  } catch (...) {
+    std::destroy_n(shards_, built);
+    shard_alloc_.deallocate(shards_, shard_count_);
+    throw;
+  }
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+ConcurrentUnorderedMap<Key, Value, Hash, Equal,
+                       Alloc>::~ConcurrentUnorderedMap() {
+  std::destroy_n(shards_, shard_count_);
+  shard_alloc_.deallocate(shards_, shard_count_);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+size_t ConcurrentUnorderedMap<Key, Value, Hash, Equal, Alloc>::size() const {
+  size_t total = 0;
+  for (size_t i = 0; i < shard_count_; ++i) {
+    std::shared_lock lock(shards_[i].mutex);
+    total += shards_[i].map.size();
+  }
+  return total;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+void ConcurrentUnorderedMap<Key, Value, Hash, Equal, Alloc>::clear() {
+  for (size_t i = 0; i < shard_count_; ++i) {
+    std::unique_lock lock(shards_[i].mutex);
+    shards_[i].map.clear();
+  }
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+std::optional<Value> ConcurrentUnorderedMap<Key, Value, Hash, Equal,
+                                            Alloc>::find(const Key& key) const {
+  std::optional<Value> result;
+  cvisit(key, [&result](const Value& value) { result.emplace(value); });
+  return result;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+template <typename V>
+bool ConcurrentUnorderedMap<Key, Value, Hash, Equal, Alloc>::insert_or_assign(
+    const Key& key, V&& value) {
+  size_t hash = hash_(key);
+  Shard& shard = shard_of(hash);
+  std::unique_lock lock(shard.mutex);
+  auto [it, inserted] =
+      shard.map.try_emplace_hashed(key, hash, std::forward<V>(value));
+  if (!inserted) {
+    it->second = std::forward<V>(value);
+  }
+  return inserted;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+size_t ConcurrentUnorderedMap<Key, Value, Hash, Equal, Alloc>::erase(
+    const Key& key) {
+  size_t hash = hash_(key);
+  Shard& shard = shard_of(hash);
+  std::unique_lock lock(shard.mutex);
+  return shard.map.erase_hashed(key, hash);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+template <typename Fn>
+bool ConcurrentUnorderedMap<Key, Value, Hash, Equal, Alloc>::visit(
+    const Key& key, Fn fn) {
+  size_t hash = hash_(key);
+  Shard& shard = shard_of(hash);
+  std::unique_lock lock(shard.mutex);
+  auto it = shard.map.find_hashed(key, hash);
+  if (it == shard.map.end()) {
+    return false;
+  }
+  fn(it->second);
+  return true;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+template <typename Fn>
+bool ConcurrentUnorderedMap<Key, Value, Hash, Equal, Alloc>::cvisit(
+    const Key& key, Fn fn) const {
+  size_t hash = hash_(key);
+  const Shard& shard = shard_of(hash);
+  std::shared_lock lock(shard.mutex);
+  auto it = shard.map.find_hashed(key, hash);
+  if (it == shard.map.end()) {
+    return false;
+  }
+  fn(std::as_const(it->second));
+  return true;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+template <typename Fn>
+void ConcurrentUnorderedMap<Key, Value, Hash, Equal, Alloc>::for_each(
+    Fn fn, size_t threads) const {
+  threads = std::clamp<size_t>(threads, 1, shard_count_);
+  auto scan = [this, &fn, threads](size_t first) {
+    for (size_t i = first; i < shard_count_; i += threads) {
+      std::shared_lock lock(shards_[i].mutex);
+      for (const value_type& value : shards_[i].map) {
+        fn(value);
+      }
+    }
+  };
+  std::vector<std::thread> workers;
+  workers.reserve(threads - 1);
+  auto join = [&workers] {
+    for (std::thread& worker : workers) {
+      worker.join();
+    }
+  };
+  try {
+    for (size_t i = 1; i < threads; ++i) {
+      workers.emplace_back(scan, i);
+    }
+    scan(0);
+  } catch (...) {
+    join();
+    throw;
+  }
+  join();
+}
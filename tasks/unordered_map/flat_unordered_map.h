@@ -0,0 +1,855 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+// NO_SIMD selects the portable group matching.
+#if defined(__SSE2__) && !defined(NO_SIMD)
+#define FLAT_MAP_SSE2
+#include <emmintrin.h>
+#endif
+
+// Sixteen control bytes of FlatUnorderedMap, compared at once. A byte is
+// empty, deleted, or the low 7 bits of the hash of a full slot. Every
+// match returns a mask with bit i set for byte i.
+class ControlGroup {
+ public:
+  static const int8_t empty = -128;
+  static const int8_t deleted = -2;
+  static const size_t width = 16;
+
+ private:
+#ifdef FLAT_MAP_SSE2
+  __m128i bytes_;
+#else
+  // Two words of eight bytes, byte i of a word in bits 8i to 8i + 7.
+  std::array<uint64_t, 2> words_;
+
+  static const uint64_t low_bits = 0x0101010101010101ULL;
+  static const uint64_t high_bits = 0x8080808080808080ULL;
+
+  // Moves the high bit of each byte to bit i of an 8-bit mask.
+  static uint32_t gather(uint64_t high) {
+    return static_cast<uint32_t>(((high >> 7) * 0x0102040810204080ULL) >> 56);
+  }
+  template <typename WordMatch>
+  uint32_t match_words(WordMatch word_match) const {
+    return gather(word_match(words_[0])) | gather(word_match(words_[1])) << 8;
+  }
+#endif
+
+ public:
+#ifdef FLAT_MAP_SSE2
+  explicit ControlGroup(const int8_t* ctrl)
+      : bytes_(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl))) {
+  }
+
+  uint32_t match(int8_t fragment) const {
+    return static_cast<uint32_t>(_mm_movemask_epi8(
+        _mm_cmpeq_epi8(_mm_set1_epi8(fragment), bytes_)));
+  }
+  uint32_t match_empty() const {
+    return match(empty);
+  }
+  // Both special values are below -1, hash fragments are not negative.
+  uint32_t match_empty_or_deleted() const {
+    return static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), bytes_)));
+  }
+#else
+  explicit ControlGroup(const int8_t* ctrl)
+      : words_() {
+    if constexpr (std::endian::native == std::endian::little) {
+      std::memcpy(words_.data(), ctrl, width);
+      return;
+    }
+    for (size_t i = 0; i < width; ++i) {
+      words_[i / 8] |= static_cast<uint64_t>(static_cast<uint8_t>(ctrl[i]))
+                       << (8 * (i % 8));
+    }
+  }
+
+  // A byte equal to fragment becomes zero; the sum sets the high bit of
+  // every byte that is not zero, without carrying into the next byte.
+  uint32_t match(int8_t fragment) const {
+    return match_words([fragment](uint64_t word) {
+      uint64_t bytes = word ^ (low_bits * static_cast<uint8_t>(fragment));
+      return ~(((bytes & ~high_bits) + ~high_bits) | bytes) & high_bits;
+    });
+  }
+  uint32_t match_empty() const {
+    return match(empty);
+  }
+  // Both special values have the high bit set and the low bit clear.
+  uint32_t match_empty_or_deleted() const {
+    return match_words(
+        [](uint64_t word) { return word & ~(word << 7) & high_bits; });
+  }
+#endif
+};
+
+// Open-addressing hash map in the style of Swiss tables: elements live
+// directly in a slot array, next to an array of one control byte per
+// slot. A lookup probes whole groups of control bytes for the 7-bit hash
+// fragment of the key and compares keys only on a fragment match, so a
+// miss usually touches one group and no element at all.
+//
+// The table holds at most 7/8 of its capacity, including the slots of
+// erased elements. An erased slot becomes empty again when no probe
+// sequence can have passed it as a full group, otherwise it stays
+// deleted until the next rehash.
+//
+// Growing moves the elements, so pointers, references and iterators are
+// invalidated by any insertion that grows and by rehash.
+template <typename Key, typename Value, typename Hash = std::hash<Key>,
+          typename Equal = std::equal_to<Key>,
+          typename Alloc = std::allocator<std::pair<const Key, Value>>>
+class FlatUnorderedMap {
+ public:
+  using key_type = Key;
+  using mapped_type = Value;
+  using value_type = std::pair<const Key, Value>;
+  using size_type = size_t;
+  using difference_type = ptrdiff_t;
+  using hasher = Hash;
+  using key_equal = Equal;
+  using allocator_type = Alloc;
+
+ private:
+  using ValueAlloc =
+      typename std::allocator_traits<Alloc>::template rebind_alloc<value_type>;
+  using ValueTraits = std::allocator_traits<ValueAlloc>;
+  using ControlAlloc =
+      typename std::allocator_traits<Alloc>::template rebind_alloc<int8_t>;
+  using ControlTraits = std::allocator_traits<ControlAlloc>;
+
+  static const size_t min_capacity = ControlGroup::width;
+  static constexpr bool nothrow_relocate =
+      std::is_nothrow_move_constructible_v<Key> &&
+      std::is_nothrow_move_constructible_v<Value>;
+
+  [[no_unique_address]] Hash hash_;
+  [[no_unique_address]] Equal equal_;
+  [[no_unique_address]] ValueAlloc alloc_;
+  // capacity_ + width control bytes: the last width ones repeat the first
+  // ones, so that a group can be loaded at any slot without wrapping.
+  int8_t* ctrl_ = nullptr;
+  value_type* slots_ = nullptr;
+  size_t capacity_ = 0;
+  size_t size_ = 0;
+  // Insertions into empty slots left before the table must grow.
+  size_t growth_left_ = 0;
+
+  static size_t max_size_for(size_t capacity) {
+    return capacity - capacity / 8;
+  }
+  // std::hash of an integer is the integer itself: spread its bits over
+  // both the fragment and the start position.
+  template <typename K>
+  size_t hash_of(const K& key) const {
+    auto product = static_cast<unsigned __int128>(hash_(key)) *
+                   0x9E3779B97F4A7C15ULL;
+    return static_cast<size_t>(product >> 64) ^ static_cast<size_t>(product);
+  }
+  static int8_t fragment_of(size_t hash) {
+    return static_cast<int8_t>(hash & 0x7F);
+  }
+  size_t start_of(size_t hash) const {
+    return (hash >> 7) & (capacity_ - 1);
+  }
+
+  void set_ctrl(size_t index, int8_t value) {
+    ctrl_[index] = value;
+    if (index < ControlGroup::width) {
+      ctrl_[capacity_ + index] = value;
+    }
+  }
+  bool is_full(size_t index) const {
+    return ctrl_[index] >= 0;
+  }
+
+  template <typename K>
+  size_t find_index(const K& key, size_t hash) const;
+  // First empty or deleted slot on the probe sequence of hash.
+  size_t find_free(size_t hash) const;
+  // Slot for a new element with this hash, growing if needed. The caller
+  // constructs the element and then calls commit.
+  size_t prepare_insert(size_t hash);
+  void commit(size_t index, size_t hash) {
+    growth_left_ -= static_cast<size_t>(ctrl_[index] == ControlGroup::empty);
+    set_ctrl(index, fragment_of(hash));
+    ++size_;
+  }
+  void erase_at(size_t index);
+
+  void allocate_table(size_t capacity);
+  void deallocate_table();
+  void destroy_elements();
+  void resize(size_t capacity);
+  void relocate(value_type* target, value_type* source);
+  void copy_from(const FlatUnorderedMap& another);
+  void steal(FlatUnorderedMap& another);
+
+  template <typename K, typename... Args>
+  std::pair<size_t, bool> emplace_key(K&& key, Args&&... args);
+
+ public:
+  template <bool IsConst>
+  class Iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::pair<const Key, Value>;
+    using difference_type = ptrdiff_t;
+    using pointer = std::conditional_t<IsConst, const value_type*, value_type*>;
+    using reference =
+        std::conditional_t<IsConst, const value_type&, value_type&>;
+
+   private:
+    const int8_t* ctrl_ = nullptr;
+    const int8_t* end_ = nullptr;
+    value_type* slot_ = nullptr;
+
+    template <bool IsOtherConst>
+    friend class Iterator;
+    friend class FlatUnorderedMap;
+
+    Iterator(const int8_t* ctrl, const int8_t* end, value_type* slot)
+        : ctrl_(ctrl),
+          end_(end),
+          slot_(slot) {
+    }
+
+    void skip_free() {
+      while (ctrl_ != end_ && *ctrl_ < 0) {
+        ++ctrl_;
+        ++slot_;
+      }
+    }
+
+   public:
+    Iterator() = default;
+
+    operator Iterator<true>() const
+      requires(!IsConst)
+    {
+      return {ctrl_, end_, slot_};
+    }
+
+    reference operator*() const {
+      return *slot_;
+    }
+    pointer operator->() const {
+      return slot_;
+    }
+
+    Iterator& operator++() {
+      ++ctrl_;
+      ++slot_;
+      skip_free();
+      return *this;
+    }
+    Iterator operator++(int) {
+      Iterator copy = *this;
+      ++*this;
+      return copy;
+    }
+
+    template <bool IsOtherConst>
+    bool operator==(const Iterator<IsOtherConst>& another) const {
+      return slot_ == another.slot_;
+    }
+  };
+
+  using iterator = Iterator<false>;
+  using const_iterator = Iterator<true>;
+
+ private:
+  iterator iterator_at(size_t index) const {
+    return iterator(ctrl_ + index, ctrl_ + capacity_, slots_ + index);
+  }
+
+ public:
+  FlatUnorderedMap() = default;
+  explicit FlatUnorderedMap(size_t bucket_count, const Hash& hash = Hash(),
+                            const Equal& equal = Equal(),
+                            const Alloc& alloc = Alloc());
+  explicit FlatUnorderedMap(const Alloc& alloc)
+      : alloc_(alloc) {
+  }
+  FlatUnorderedMap(std::initializer_list<value_type> values,
+                   const Alloc& alloc = Alloc());
+  FlatUnorderedMap(const FlatUnorderedMap& another);
+  FlatUnorderedMap(const FlatUnorderedMap& another, const Alloc& alloc);
+  FlatUnorderedMap(FlatUnorderedMap&& another) noexcept;
+
+  FlatUnorderedMap& operator=(const FlatUnorderedMap& another);
+  FlatUnorderedMap& operator=(FlatUnorderedMap&& another) noexcept(
+      std::allocator_traits<Alloc>::propagate_on_container_move_assignment::
+          value ||
+      std::allocator_traits<Alloc>::is_always_equal::value);
+
+  ~FlatUnorderedMap() {
+    destroy_elements();
+    deallocate_table();
+  }
+
+  iterator begin() {
+    iterator result = iterator_at(0);
+    result.skip_free();
+    return result;
+  }
+  const_iterator begin() const {
+    return const_cast<FlatUnorderedMap*>(this)->begin();
+  }
+  const_iterator cbegin() const {
+    return begin();
+  }
+  iterator end() {
+    return iterator_at(capacity_);
+  }
+  const_iterator end() const {
+    return iterator_at(capacity_);
+  }
+  const_iterator cend() const {
+    return end();
+  }
+
+  size_t size() const {
+    return size_;
+  }
+  bool empty() const {
+    return size_ == 0;
+  }
+  size_t bucket_count() const {
+    return capacity_;
+  }
+  float load_factor() const {
+    return capacity_ == 0 ? 0.0F
+                          : static_cast<float>(size_) /
+                                static_cast<float>(capacity_);
+  }
+  float max_load_factor() const {
+    return 0.875F;
+  }
+
+  allocator_type get_allocator() const {
+    return allocator_type(alloc_);
+  }
+  hasher hash_function() const {
+    return hash_;
+  }
+  key_equal key_eq() const {
+    return equal_;
+  }
+
+  iterator find(const Key& key) {
+    return iterator_at(find_index(key, hash_of(key)));
+  }
+  const_iterator find(const Key& key) const {
+    return iterator_at(find_index(key, hash_of(key)));
+  }
+  bool contains(const Key& key) const {
+    return find_index(key, hash_of(key)) != capacity_;
+  }
+  size_t count(const Key& key) const {
+    return static_cast<size_t>(contains(key));
+  }
+
+  Value& at(const Key& key);
+  const Value& at(const Key& key) const;
+  Value& operator[](const Key& key) {
+    return try_emplace(key).first->second;
+  }
+  Value& operator[](Key&& key) {
+    return try_emplace(std::move(key)).first->second;
+  }
+
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args) {
+    auto [index, inserted] = emplace_key(key, std::forward<Args>(args)...);
+    return {iterator_at(index), inserted};
+  }
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args) {
+    auto [index, inserted] =
+        emplace_key(std::move(key), std::forward<Args>(args)...);
+    return {iterator_at(index), inserted};
+  }
+  // The element is built first to learn its key; a duplicate is dropped.
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(Args&&... args) {
+    std::pair<Key, Value> element(std::forward<Args>(args)...);
+    return try_emplace(std::move(element.first), std::move(element.second));
+  }
+  std::pair<iterator, bool> insert(const value_type& value) {
+    return try_emplace(value.first, value.second);
+  }
+  std::pair<iterator, bool> insert(value_type&& value) {
+    return try_emplace(value.first, std::move(value.second));
+  }
+  template <typename InputIt>
+  void insert(InputIt first, InputIt last) {
+    for (; first != last; ++first) {
+      insert(*first);
+    }
+  }
+  void insert(std::initializer_list<value_type> values) {
+    insert(values.begin(), values.end());
+  }
+
+  iterator erase(const_iterator pos) {
+    iterator next = iterator_at(static_cast<size_t>(pos.slot_ - slots_));
+    ++next;
+    erase_at(static_cast<size_t>(pos.slot_ - slots_));
+    return next;
+  }
+  iterator erase(const_iterator first, const_iterator last) {
+    while (first != last) {
+      first = erase(first);
+    }
+    return iterator_at(static_cast<size_t>(last.slot_ - slots_));
+  }
+  size_t erase(const Key& key) {
+    size_t index = find_index(key, hash_of(key));
+    if (index == capacity_) {
+      return 0;
+    }
+    erase_at(index);
+    return 1;
+  }
+
+  // Destroys the elements and keeps the capacity.
+  void clear();
+  void reserve(size_t count);
+  // Rebuilds the table with room for at least count elements and without
+  // deleted slots.
+  void rehash(size_t count);
+  void swap(FlatUnorderedMap& another) noexcept;
+};
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+template <typename K>
+size_t FlatUnorderedMap<Key, Value, Hash, Equal, Alloc>::find_index(
+    const K& key, size_t hash) const {
+  if (size_ == 0) {
+    return capacity_;
+  }
+  const size_t mask = capacity_ - 1;
+  int8_t fragment = fragment_of(hash);
+  size_t position = start_of(hash);
+  // triangular steps of whole groups visit every group once
+  for (size_t step = ControlGroup::width;; step += ControlGroup::width) {
+    ControlGroup group(ctrl_ + position);
+    for (uint32_t match = group.match(fragment); match != 0;
+         match &= match - 1) {
+      size_t index = (position + std::countr_zero(match)) & mask;
+      if (equal_(slots_[index].first, key)) {
+        return index;
+      }
+    }
+    if (group.match_empty() != 0) {
+      return capacity_;
+    }
+    position = (position + step) & mask;
+  }
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+size_t FlatUnorderedMap<Key, Value, Hash, Equal, Alloc>::find_free(
+    size_t hash) const {
+  const size_t mask = capacity_ - 1;
+  size_t position = start_of(hash);
+  for (size_t step = ControlGroup::width;; step += ControlGroup::width) {
+    uint32_t match = ControlGroup(ctrl_ + position).match_empty_or_deleted();
+    if (match != 0) {
+      return (position + std::countr_zero(match)) & mask;
+    }
+    position = (position + step) & mask;
+  }
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+size_t FlatUnorderedMap<Key, Value, Hash, Equal, Alloc>::prepare_insert(
+    size_t hash) {
+  if (capacity_ == 0) {
+    resize(min_capacity);
+  }
+  size_t index = find_free(hash);
+  if (growth_left_ == 0 && ctrl_[index] != ControlGroup::deleted) {
+    // many deleted slots: rebuild at the same size, otherwise grow
+    if (size_ * 2 < max_size_for(capacity_)) {
+      resize(capacity_);
+    } else {
+      resize(capacity_ * 2);
+    }
+    index = find_free(hash);
+  }
+  return index;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+template <typename K, typename... Args>
+std::pair<size_t, bool>
+FlatUnorderedMap<Key, Value, Hash, Equal, Alloc>::emplace_key(
+    K&& key, Args&&... args) {
+  size_t hash = hash_of(key);
+  size_t index = find_index(key, hash);
+  if (index != capacity_) {
+    return {index, false};
+  }
+  index = prepare_insert(hash);
+  ValueTraits::construct(alloc_, slots_ + index, std::piecewise_construct,
+                         std::forward_as_tuple(std::forward<K>(key)),
+                         std::forward_as_tuple(std::forward<Args>(args)...));
+  commit(index, hash);
+  return {index, true};
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+void FlatUnorderedMap<Key, Value, Hash, Equal, Alloc>::erase_at(
+    size_t index) {
+  ValueTraits::destroy(alloc_, slots_ + index);
+  --size_;
+  // A probe passes this slot only inside a window of width full or
+  // deleted slots. If the empty slots around it leave no room for one,
+  // the slot can be empty again.
+  const size_t mask = capacity_ - 1;
+  size_t before = (index - ControlGroup::width) & mask;
+  uint32_t empty_after = ControlGroup(ctrl_ + index).match_empty();
+  uint32_t empty_before = ControlGroup(ctrl_ + before).match_empty();
+  bool was_never_full =
+      empty_before != 0 && empty_after != 0 &&
+      static_cast<size_t>(std::countr_zero(empty_after) +
+                          std::countl_zero(empty_before << 16)) <
+          ControlGroup::width;
+  if (was_never_full) {
+    set_ctrl(index, ControlGroup::empty);
+    ++growth_left_;
+  } else {
+    set_ctrl(index, ControlGroup::deleted);
+  }
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+void FlatUnorderedMap<Key, Value, Hash, Equal, Alloc>::allocate_table(
+    size_t capacity) {
+  ControlAlloc ctrl_alloc(alloc_);
+  int8_t* ctrl = std::to_address(
+      ControlTraits::allocate(ctrl_alloc, capacity + ControlGroup::width));
+  value_type* slots = nullptr;
+  try {
+    slots = std::to_address(ValueTraits::allocate(alloc_, capacity));
+  } catch (...) {
+    ControlTraits::deallocate(ctrl_alloc, ctrl, capacity + ControlGroup::width);
+    throw;
+  }
+  std::memset(ctrl, ControlGroup::empty, capacity + ControlGroup::width);
+  ctrl_ = ctrl;
+  slots_ = slots;
+  capacity_ = capacity;
+  growth_left_ = max_size_for(capacity);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+void FlatUnorderedMap<Key, Value, Hash, Equal, Alloc>::deallocate_table() {
+  if (capacity_ == 0) {
+    return;
+  }
+  ControlAlloc ctrl_alloc(alloc_);
+  ControlTraits::deallocate(ctrl_alloc, ctrl_, capacity_ + ControlGroup::width);
+  ValueTraits::deallocate(alloc_, slots_, capacity_);
+  ctrl_ = nullptr;
+  slots_ = nullptr;
+  capacity_ = 0;
+  size_ = 0;
+  growth_left_ = 0;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+void FlatUnorderedMap<Key, Value, Hash, Equal, Alloc>::destroy_elements() {
+  if (size_ == 0) {
+    return;
+  }
+  for (size_t i = 0; i < capacity_; ++i) {
+    if (is_full(i)) {
+      ValueTraits::destroy(alloc_, slots_ + i);
+    }
+  }
+}
+
+// The key is moved out of a slot that is destroyed right after, nothing
+// can observe it in between. Elements that may throw on move are copied,
+// so that a throwing copy leaves the old table intact.
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+void FlatUnorderedMap<Key, Value, Hash, Equal, Alloc>::relocate(
+    value_type* target, value_type* source) {
+  if constexpr (nothrow_relocate) {
+    ValueTraits::construct(alloc_, target,
+                           std::move(const_cast<Key&>(source->first)),
+                           std::move(source->second));
+  } else {
+    ValueTraits::construct(alloc_, target, *source);
+  }
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+void FlatUnorderedMap<Key, Value, Hash, Equal, Alloc>::resize(
+    size_t capacity) {
+  FlatUnorderedMap old(alloc_);
+  old.steal(*this);
+  try {
+    allocate_table(capacity);
+    for (size_t i = 0; i < old.capacity_; ++i) {
+      if (!old.is_full(i)) {
+        continue;
+      }
+      size_t hash = hash_of(old.slots_[i].first);
+      size_t index = find_free(hash);
+      relocate(slots_ + index, old.slots_ + i);
+      commit(index, hash);
+    }
+  } catch (...) {
+    destroy_elements();
+    deallocate_table();
+    steal(old);
+    throw;
+  }
+  // old now destroys the moved-from or copied elements
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+void FlatUnorderedMap<Key, Value, Hash, Equal, Alloc>::copy_from(
+    const FlatUnorderedMap& another) {
+  if (another.size_ == 0) {
+    return;
+  }
+  allocate_table(another.capacity_);
+  size_t copied = 0;
+  try {
+    for (; copied < capacity_; ++copied) {
+      if (another.is_full(copied)) {
+        ValueTraits::construct(alloc_, slots_ + copied,
+                               another.slots_[copied]);
+      }
+    }
+  } catch (...) {
+    for (size_t i = 0; i < copied; ++i) {
+      if (another.is_full(i)) {
+        ValueTraits::destroy(alloc_, slots_ + i);
+      }
+    }
+    deallocate_table();
+    throw;
+  }
+  std::memcpy(ctrl_, another.ctrl_, capacity_ + ControlGroup::width);
+  size_ = another.size_;
+  growth_left_ = another.growth_left_;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+void FlatUnorderedMap<Key, Value, Hash, Equal, Alloc>::steal(
+    FlatUnorderedMap& another) {
+  ctrl_ = std::exchange(another.ctrl_, nullptr);
+  slots_ = std::exchange(another.slots_, nullptr);
+  capacity_ = std::exchange(another.capacity_, 0);
+  size_ = std::exchange(another.size_, 0);
+  growth_left_ = std::exchange(another.growth_left_, 0);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+FlatUnorderedMap<Key, Value, Hash, Equal, Alloc>::FlatUnorderedMap(
+    size_t bucket_count, const Hash& hash, const Equal& equal,
+    const Alloc& alloc)
+    : hash_(hash),
+      equal_(equal),
+      alloc_(alloc) {
+  reserve(bucket_count);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+FlatUnorderedMap<Key, Value, Hash, Equal, Alloc>::FlatUnorderedMap(
+    std::initializer_list<value_type> values, const Alloc& alloc)
+    : alloc_(alloc) {
+  reserve(values.size());
+  insert(values);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+FlatUnorderedMap<Key, Value, Hash, Equal, Alloc>::FlatUnorderedMap(
+    const FlatUnorderedMap& another)
+    : hash_(another.hash_),
+      equal_(another.equal_),
+      alloc_(ValueTraits::select_on_container_copy_construction(
+          another.alloc_)) {
+  copy_from(another);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+FlatUnorderedMap<Key, Value, Hash, Equal, Alloc>::FlatUnorderedMap(
+    const FlatUnorderedMap& another, const Alloc& alloc)
+    : hash_(another.hash_),
+      equal_(another.equal_),
+      alloc_(alloc) {
+  copy_from(another);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+FlatUnorderedMap<Key, Value, Hash, Equal, Alloc>::FlatUnorderedMap(
+    FlatUnorderedMap&& another) noexcept
+    : hash_(std::move(another.hash_)),
+      equal_(std::move(another.equal_)),
+      alloc_(std::move(another.alloc_)) {
+  steal(another);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+FlatUnorderedMap<Key, Value, Hash, Equal, Alloc>&
+FlatUnorderedMap<Key, Value, Hash, Equal, Alloc>::operator=(
+    const FlatUnorderedMap& another) {
+  if (this == &another) {
+    return *this;
+  }
+  constexpr bool propagate =
+      ValueTraits::propagate_on_container_copy_assignment::value;
+  FlatUnorderedMap copy(another, propagate ? another.alloc_ : alloc_);
+  destroy_elements();
+  deallocate_table();
+  hash_ = std::move(copy.hash_);
+  equal_ = std::move(copy.equal_);
+  if constexpr (propagate) {
+    alloc_ = copy.alloc_;
+  }
+  steal(copy);
+  return *this;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+FlatUnorderedMap<Key, Value, Hash, Equal, Alloc>&
+FlatUnorderedMap<Key, Value, Hash, Equal, Alloc>::operator=(
+    FlatUnorderedMap&& another) noexcept(
+    std::allocator_traits<Alloc>::propagate_on_container_move_assignment::
+        value ||
+    std::allocator_traits<Alloc>::is_always_equal::value) {
+  if (this == &another) {
+    return *this;
+  }
+  constexpr bool propagate =
+      ValueTraits::propagate_on_container_move_assignment::value;
+  destroy_elements();
+  deallocate_table();
+  hash_ = std::move(another.hash_);
+  equal_ = std::move(another.equal_);
+  if (propagate || alloc_ == another.alloc_) {
+    if constexpr (propagate) {
+      alloc_ = std::move(another.alloc_);
+    }
+    steal(another);
+    return *this;
+  }
+  // the storage belongs to the other allocator: move element by element
+  reserve(another.size_);
+  for (auto& value : another) {
+    emplace_key(std::move(const_cast<Key&>(value.first)),
+                std::move(value.second));
+  }
+  another.clear();
+  return *this;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+Value& FlatUnorderedMap<Key, Value, Hash, Equal, Alloc>::at(const Key& key) {
+  size_t index = find_index(key, hash_of(key));
+  if (index == capacity_) {
+    throw std::out_of_range("FlatUnorderedMap::at: no such key");
+  }
+  return slots_[index].second;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+const Value& FlatUnorderedMap<Key, Value, Hash, Equal, Alloc>::at(
+    const Key& key) const {
+  return const_cast<FlatUnorderedMap*>(this)->at(key);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+void FlatUnorderedMap<Key, Value, Hash, Equal, Alloc>::clear() {
+  destroy_elements();
+  if (capacity_ != 0) {
+    std::memset(ctrl_, ControlGroup::empty, capacity_ + ControlGroup::width);
+  }
+  size_ = 0;
+  growth_left_ = max_size_for(capacity_);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+void FlatUnorderedMap<Key, Value, Hash, Equal, Alloc>::reserve(size_t count) {
+  if (capacity_ == 0 ? count > 0 : count > size_ + growth_left_) {
+    rehash(count);
+  }
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+void FlatUnorderedMap<Key, Value, Hash, Equal, Alloc>::rehash(size_t count) {
+  count = std::max(count, size_);
+  if (count == 0 && capacity_ == 0) {
+    return;
+  }
+  size_t capacity = min_capacity;
+  while (max_size_for(capacity) < count) {
+    capacity *= 2;
+  }
+  resize(capacity);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+void FlatUnorderedMap<Key, Value, Hash, Equal, Alloc>::swap(
+    FlatUnorderedMap& another) noexcept {
+  using std::swap;
+  swap(hash_, another.hash_);
+  swap(equal_, another.equal_);
+  if constexpr (ValueTraits::propagate_on_container_swap::value) {
+    swap(alloc_, another.alloc_);
+  }
+  swap(ctrl_, another.ctrl_);
+  swap(slots_, another.slots_);
+  swap(capacity_, another.capacity_);
+  swap(size_, another.size_);
+  swap(growth_left_, another.growth_left_);
+}
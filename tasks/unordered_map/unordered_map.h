@@ -0,0 +1,1142 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "../list/stackallocator.h"
+
+// Hash and Equal that also take types other than the key, such as
+// std::string_view for std::string keys, mark it with is_transparent as
+// for the standard containers. The map then looks such keys up as they
+// are, without building a Key.
+template <typename Hash, typename Equal>
+concept TransparentLookup = requires {
+  typename Hash::is_transparent;
+  typename Equal::is_transparent;
+};
+
+// Whether UnorderedMap keeps the hash of each key in its node. A rehash
+// then never calls Hash, and a lookup compares keys only when the hashes
+// match. On for keys that are not trivially copyable, such as strings,
+// whose hashing and comparison are costly; integers are cheaper to hash
+// again than to store. Specialize it to choose for a key type.
+template <typename Key>
+struct CacheHash : std::bool_constant<!std::is_trivially_copyable_v<Key>> {};
+
+// Node-based hash map: all elements live in one List, and each bucket
+// points at the first element of its run there, the elements of a bucket
+// being adjacent in the list. Nodes never move, so pointers, references
+// and iterators stay valid until their element is erased; a rehash only
+// relinks the nodes.
+//
+// The nodes and the bucket array come from Alloc, so a whole map can live
+// in a StackStorage. With an arena allocator such as StackArenaAllocator
+// (see ArenaAllocator) and trivially destructible elements, clear and the
+// destructor leave the memory to the arena and take O(1).
+//
+// With incremental_rehash(true), growing allocates the new bucket array
+// and leaves the nodes where they are. Each following insertion moves at
+// least rehash_step old buckets over, and enough of them to be done
+// before the table fills up again, about 1 / max_load_factor(). A key
+// stays in the old table until its bucket has moved, and a lookup goes
+// straight to the table that holds it. Only insertions are bounded this
+// way: erase does not migrate, so that erasing while iterating keeps the
+// order, and rehash, reserve, max_load_factor and
+// incremental_rehash(false) still relink the whole table in one call.
+//
+// Hash must not throw while the map rehashes, unless CacheHash<Key> is on
+// and it is never called there.
+template <typename Key, typename Value, typename Hash = std::hash<Key>,
+          typename Equal = std::equal_to<Key>,
+          typename Alloc = std::allocator<std::pair<const Key, Value>>>
+class UnorderedMap {
+ public:
+  using key_type = Key;
+  using mapped_type = Value;
+  using value_type = std::pair<const Key, Value>;
+  using size_type = size_t;
+  using difference_type = ptrdiff_t;
+  using hasher = Hash;
+  using key_equal = Equal;
+  using allocator_type = Alloc;
+
+ private:
+  static constexpr bool cache_hash = CacheHash<Key>::value;
+
+  struct NoHash {};
+
+  // A list element: the value, and its hash if cache_hash.
+  struct Element {
+    value_type value;
+    [[no_unique_address]] std::conditional_t<cache_hash, size_t, NoHash> hash;
+
+    template <typename... Args>
+    explicit Element(size_t hash_value, Args&&... args)
+        : value(std::forward<Args>(args)...) {
+      if constexpr (cache_hash) {
+        hash = hash_value;
+      }
+    }
+  };
+
+  using ElementAlloc =
+      typename std::allocator_traits<Alloc>::template rebind_alloc<Element>;
+  using ElementTraits = std::allocator_traits<ElementAlloc>;
+  using NodeList = List<Element, ElementAlloc>;
+  using ListIterator = typename NodeList::iterator;
+  using BucketAlloc = typename std::allocator_traits<
+      Alloc>::template rebind_alloc<ListIterator>;
+  using BucketTraits = std::allocator_traits<BucketAlloc>;
+
+ public:
+  template <bool IsConst>
+  class Iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::pair<const Key, Value>;
+    using difference_type = ptrdiff_t;
+    using pointer = std::conditional_t<IsConst, const value_type*, value_type*>;
+    using reference =
+        std::conditional_t<IsConst, const value_type&, value_type&>;
+
+   private:
+    ListIterator it_;
+
+    template <bool IsOtherConst>
+    friend class Iterator;
+    friend class UnorderedMap;
+
+    explicit Iterator(ListIterator it)
+        : it_(it) {
+    }
+
+   public:
+    Iterator() = default;
+
+    operator Iterator<true>() const
+      requires(!IsConst)
+    {
+      return Iterator<true>(it_);
+    }
+
+    reference operator*() const {
+      return it_->value;
+    }
+    pointer operator->() const {
+      return &it_->value;
+    }
+
+    Iterator& operator++() {
+      ++it_;
+      return *this;
+    }
+    Iterator operator++(int) {
+      Iterator copy = *this;
+      ++it_;
+      return copy;
+    }
+
+    template <bool IsOtherConst>
+    bool operator==(const Iterator<IsOtherConst>& another) const {
+      return it_ == another.it_;
+    }
+  };
+
+  using iterator = Iterator<false>;
+  using const_iterator = Iterator<true>;
+
+  // An element taken out by extract. insert links it into a map with an
+  // equal allocator as it is: nothing is allocated, copied or moved.
+  class node_type {
+   private:
+    typename NodeList::node_type handle_;
+
+    friend class UnorderedMap;
+
+    explicit node_type(typename NodeList::node_type&& handle)
+        : handle_(std::move(handle)) {
+    }
+
+   public:
+    node_type() = default;
+
+    bool empty() const {
+      return handle_.empty();
+    }
+    explicit operator bool() const {
+      return !empty();
+    }
+    allocator_type get_allocator() const {
+      return allocator_type(handle_.get_allocator());
+    }
+    key_type& key() const {
+      return const_cast<Key&>(handle_.value().value.first);
+    }
+    mapped_type& mapped() const {
+      return handle_.value().value.second;
+    }
+  };
+
+  struct insert_return_type {
+    iterator position;
+    bool inserted;
+    node_type node;
+  };
+
+ private:
+  static const size_t min_bucket_count = 8;
+  // clear gives the buckets back to the arena too instead of resetting them
+  static constexpr bool drops_nodes =
+      ArenaAllocator<ElementAlloc> && std::is_trivially_destructible_v<Element>;
+
+  [[no_unique_address]] Hash hash_;
+  [[no_unique_address]] Equal equal_;
+  NodeList list_;
+  // The first element of each bucket, a default iterator if it is empty.
+  ListIterator* buckets_ = nullptr;
+  size_t bucket_count_ = 0;
+  float max_load_factor_ = 1.0F;
+  bool incremental_ = false;
+  // While the map migrates, old buckets from migrated_ on still hold
+  // their nodes, which form the tail of the list from old_begin_ (a
+  // default iterator if there are none). The other nodes precede them,
+  // and buckets_ only covers the slots the migrated buckets map to.
+  ListIterator* old_buckets_ = nullptr;
+  size_t old_bucket_count_ = 0;
+  size_t migrated_ = 0;
+  ListIterator old_begin_;
+
+  // A bucket in the table that holds its hash, and where the list part of
+  // that table ends.
+  struct Run {
+    ListIterator* first;
+    size_t index;
+    size_t mask;
+    ListIterator stop;
+    bool old;
+  };
+
+  size_t bucket_of(size_t hash) const {
+    return hash & (bucket_count_ - 1);
+  }
+  ListIterator list_begin() const {
+    return const_cast<NodeList&>(list_).begin();
+  }
+  ListIterator list_end() const {
+    return const_cast<NodeList&>(list_).end();
+  }
+  size_t hash_of(ListIterator it) const {
+    if constexpr (cache_hash) {
+      return it->hash;
+    } else {
+      return hash_(it->value.first);
+    }
+  }
+  // Compares the stored hashes first if there are any.
+  template <typename K>
+  bool holds(ListIterator it, const K& key, size_t hash) const {
+    if constexpr (cache_hash) {
+      if (it->hash != hash) {
+        return false;
+      }
+    }
+    return equal_(it->value.first, key);
+  }
+  Run run_of(size_t hash) const;
+  bool in_run(const Run& run, ListIterator it) const {
+    return it != run.stop && (hash_of(it) & run.mask) == run.index;
+  }
+
+  // Lookups by K other than Key need transparent Hash and Equal; K must
+  // not be mistaken for a position.
+  template <typename K>
+  static constexpr bool heterogeneous =
+      TransparentLookup<Hash, Equal> &&
+      !std::is_convertible_v<K, const_iterator> &&
+      !std::is_convertible_v<K, iterator>;
+
+  template <typename K>
+  ListIterator find_node(const K& key, size_t hash) const;
+  template <typename K>
+  ListIterator find_in_run(const K& key, size_t hash, const Run& run) const;
+  template <typename It>
+  void find_batches(std::span<const Key> keys, std::span<It> out) const;
+  template <typename K, typename... Args>
+  std::pair<iterator, bool> emplace_key(size_t hash, K&& key,
+                                        Args&&... args);
+  // Puts a node for hash at the head of its run, after grow_for_insert;
+  // link(pos) links it into the list before pos.
+  template <typename Link>
+  iterator link_into_run(size_t hash, Link link);
+  // Drops the node at it from its run before it leaves the list.
+  void detach(ListIterator it);
+
+  template <typename K>
+  size_t erase_key(const K& key, size_t hash);
+  template <typename K>
+  node_type extract_key(const K& key);
+  template <typename It>
+  std::pair<It, It> range_of(It it) const {
+    return {it, it.it_ == list_end() ? it : std::next(it)};
+  }
+
+  ListIterator* allocate_buckets(size_t count);
+  void deallocate_buckets();
+  void release_old_buckets();
+  // Moves to count buckets, a power of two, and relinks every node.
+  void rebuild(size_t count);
+  // Makes room for one more element, starting a migration if enabled.
+  void grow_for_insert();
+  // Old buckets to move on an insertion below limit elements, so that
+  // the migration ends by the time the table is full.
+  size_t migration_step(float limit) const;
+  void start_migration();
+  // Moves up to count old buckets into the new table.
+  void migrate(size_t count);
+  void finish_migration() {
+    migrate(old_bucket_count_);
+  }
+
+ public:
+  UnorderedMap() = default;
+  explicit UnorderedMap(size_t bucket_count, const Hash& hash = Hash(),
+                        const Equal& equal = Equal(),
+                        const Alloc& alloc = Alloc());
+  explicit UnorderedMap(const Alloc& alloc)
+      : list_(ElementAlloc(alloc)) {
+  }
+  UnorderedMap(std::initializer_list<value_type> values,
+               const Alloc& alloc = Alloc());
+  UnorderedMap(const UnorderedMap& another);
+  UnorderedMap(const UnorderedMap& another, const Alloc& alloc);
+  UnorderedMap(UnorderedMap&& another) noexcept;
+
+  UnorderedMap& operator=(const UnorderedMap& another);
+  UnorderedMap& operator=(UnorderedMap&& another) noexcept(
+      std::allocator_traits<Alloc>::propagate_on_container_move_assignment::
+          value ||
+      std::allocator_traits<Alloc>::is_always_equal::value);
+
+  // The nodes go first: they usually come after the bucket array, and a
+  // stack storage reclaims only the block on top.
+  ~UnorderedMap() {
+    list_.clear();
+    deallocate_buckets();
+  }
+
+  iterator begin() {
+    return iterator(list_.begin());
+  }
+  const_iterator begin() const {
+    return const_iterator(list_begin());
+  }
+  const_iterator cbegin() const {
+    return begin();
+  }
+  iterator end() {
+    return iterator(list_.end());
+  }
+  const_iterator end() const {
+    return const_iterator(list_end());
+  }
+  const_iterator cend() const {
+    return end();
+  }
+
+  size_t size() const {
+    return list_.size();
+  }
+  bool empty() const {
+    return list_.empty();
+  }
+  size_t bucket_count() const {
+    return bucket_count_;
+  }
+  float load_factor() const {
+    return bucket_count_ == 0 ? 0.0F
+                              : static_cast<float>(size()) /
+                                    static_cast<float>(bucket_count_);
+  }
+  float max_load_factor() const {
+    return max_load_factor_;
+  }
+  void max_load_factor(float factor) {
+    max_load_factor_ = factor;
+    reserve(size());
+  }
+
+  // Fewest old buckets moved per insertion while the map migrates.
+  static constexpr size_t rehash_step = 8;
+
+  bool incremental_rehash() const {
+    return incremental_;
+  }
+  // Switching it off completes a migration in progress.
+  void incremental_rehash(bool enabled) {
+    incremental_ = enabled;
+    if (!enabled) {
+      finish_migration();
+    }
+  }
+  bool migrating() const {
+    return old_buckets_ != nullptr;
+  }
+
+  allocator_type get_allocator() const {
+    return allocator_type(list_.get_allocator());
+  }
+  hasher hash_function() const {
+    return hash_;
+  }
+  key_equal key_eq() const {
+    return equal_;
+  }
+
+  iterator find(const Key& key) {
+    return iterator(find_node(key, hash_(key)));
+  }
+  const_iterator find(const Key& key) const {
+    return const_iterator(find_node(key, hash_(key)));
+  }
+  template <typename K>
+    requires heterogeneous<K>
+  iterator find(const K& key) {
+    return iterator(find_node(key, hash_(key)));
+  }
+  template <typename K>
+    requires heterogeneous<K>
+  const_iterator find(const K& key) const {
+    return const_iterator(find_node(key, hash_(key)));
+  }
+  bool contains(const Key& key) const {
+    return find(key) != end();
+  }
+  template <typename K>
+    requires heterogeneous<K>
+  bool contains(const K& key) const {
+    return find(key) != end();
+  }
+  size_t count(const Key& key) const {
+    return static_cast<size_t>(contains(key));
+  }
+  template <typename K>
+    requires heterogeneous<K>
+  size_t count(const K& key) const {
+    return static_cast<size_t>(contains(key));
+  }
+  std::pair<iterator, iterator> equal_range(const Key& key) {
+    return range_of(find(key));
+  }
+  std::pair<const_iterator, const_iterator> equal_range(const Key& key) const {
+    return range_of(find(key));
+  }
+  template <typename K>
+    requires heterogeneous<K>
+  std::pair<iterator, iterator> equal_range(const K& key) {
+    return range_of(find(key));
+  }
+  template <typename K>
+    requires heterogeneous<K>
+  std::pair<const_iterator, const_iterator> equal_range(const K& key) const {
+    return range_of(find(key));
+  }
+
+  // Keys hashed and prefetched together by find_many.
+  static constexpr size_t lookup_batch = 16;
+
+  // Sets out[i] to find(keys[i]). The keys go in batches: all buckets of
+  // a batch are prefetched, then their first nodes, then the nodes after
+  // those, and only then are the keys compared, so that the cache misses
+  // of a batch overlap. Throws std::invalid_argument if out is shorter
+  // than keys.
+  void find_many(std::span<const Key> keys, std::span<iterator> out) {
+    find_batches(keys, out);
+  }
+  void find_many(std::span<const Key> keys,
+                 std::span<const_iterator> out) const {
+    find_batches(keys, out);
+  }
+
+  Value& at(const Key& key);
+  const Value& at(const Key& key) const;
+  Value& operator[](const Key& key) {
+    return try_emplace(key).first->second;
+  }
+  Value& operator[](Key&& key) {
+    return try_emplace(std::move(key)).first->second;
+  }
+
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args) {
+    return emplace_key(hash_(key), key, std::forward<Args>(args)...);
+  }
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args) {
+    size_t hash = hash_(key);
+    return emplace_key(hash, std::move(key), std::forward<Args>(args)...);
+  }
+  // Builds the Key from key only if it is not in the map yet.
+  template <typename K, typename... Args>
+    requires heterogeneous<K> && std::is_constructible_v<Key, K&&>
+  std::pair<iterator, bool> try_emplace(K&& key, Args&&... args) {
+    size_t hash = hash_(key);
+    return emplace_key(hash, std::forward<K>(key),
+                       std::forward<Args>(args)...);
+  }
+  // The element is built first to learn its key; a duplicate is dropped.
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(Args&&... args) {
+    std::pair<Key, Value> element(std::forward<Args>(args)...);
+    return try_emplace(std::move(element.first), std::move(element.second));
+  }
+  std::pair<iterator, bool> insert(const value_type& value) {
+    return try_emplace(value.first, value.second);
+  }
+  std::pair<iterator, bool> insert(value_type&& value) {
+    return try_emplace(value.first, std::move(value.second));
+  }
+  template <typename InputIt>
+  void insert(InputIt first, InputIt last) {
+    for (; first != last; ++first) {
+      insert(*first);
+    }
+  }
+  void insert(std::initializer_list<value_type> values) {
+    insert(values.begin(), values.end());
+  }
+
+  iterator erase(const_iterator pos);
+  iterator erase(const_iterator first, const_iterator last);
+  size_t erase(const Key& key) {
+    return erase_key(key, hash_(key));
+  }
+  template <typename K>
+    requires heterogeneous<K>
+  size_t erase(K&& key) {
+    return erase_key(key, hash_(key));
+  }
+
+  // find, try_emplace and erase for a caller that has already computed
+  // hash as hash_function()(key), so that the key is not hashed twice.
+  iterator find_hashed(const Key& key, size_t hash) {
+    return iterator(find_node(key, hash));
+  }
+  const_iterator find_hashed(const Key& key, size_t hash) const {
+    return const_iterator(find_node(key, hash));
+  }
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace_hashed(const Key& key, size_t hash,
+                                               Args&&... args) {
+    return emplace_key(hash, key, std::forward<Args>(args)...);
+  }
+  size_t erase_hashed(const Key& key, size_t hash) {
+    return erase_key(key, hash);
+  }
+
+  node_type extract(const_iterator pos) {
+    detach(pos.it_);
+    return node_type(list_.extract(pos.it_));
+  }
+  // An empty node if there is no such key.
+  node_type extract(const Key& key) {
+    return extract_key(key);
+  }
+  template <typename K>
+    requires heterogeneous<K>
+  node_type extract(K&& key) {
+    return extract_key(key);
+  }
+  // If the key is taken, node comes back in the result untouched. The
+  // key may have been changed through the node, so it is hashed again.
+  insert_return_type insert(node_type&& node);
+  iterator insert(const_iterator /*hint*/, node_type&& node) {
+    return insert(std::move(node)).position;
+  }
+  // Moves in the nodes of source whose keys are not here yet; those
+  // that are stay in source. With equal allocators no element is copied
+  // or moved and no node is allocated.
+  void merge(UnorderedMap& source);
+  void merge(UnorderedMap&& source) {
+    merge(source);
+  }
+
+  // O(1) for trivially destructible elements in an arena, which also
+  // gives the buckets back; otherwise the bucket count is kept.
+  void clear();
+  void reserve(size_t count);
+  // Relinks the nodes into at least count buckets, and at least enough
+  // for size() at the maximum load factor.
+  void rehash(size_t count);
+  void swap(UnorderedMap& another) noexcept;
+};
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+template <typename K>
+typename UnorderedMap<Key, Value, Hash, Equal, Alloc>::ListIterator
+UnorderedMap<Key, Value, Hash, Equal, Alloc>::find_node(const K& key,
+                                                        size_t hash) const {
+  if (bucket_count_ == 0) {
+    return list_end();
+  }
+  return find_in_run(key, hash, run_of(hash));
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+template <typename K>
+typename UnorderedMap<Key, Value, Hash, Equal, Alloc>::ListIterator
+UnorderedMap<Key, Value, Hash, Equal, Alloc>::find_in_run(
+    const K& key, size_t hash, const Run& run) const {
+  ListIterator it = *run.first;
+  if (it == ListIterator()) {
+    return list_end();
+  }
+  // the first node is in the run, the others only when their hash says so
+  do {
+    if (holds(it, key, hash)) {
+      return it;
+    }
+    ++it;
+  } while (in_run(run, it));
+  return list_end();
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+template <typename It>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc>::find_batches(
+    std::span<const Key> keys, std::span<It> out) const {
+  if (out.size() < keys.size()) {
+    throw std::invalid_argument("UnorderedMap::find_many: out is too short");
+  }
+  if (bucket_count_ == 0) {
+    std::fill_n(out.begin(), keys.size(), It(list_end()));
+    return;
+  }
+  size_t hashes[lookup_batch];
+  Run runs[lookup_batch];
+  for (size_t base = 0; base < keys.size(); base += lookup_batch) {
+    size_t count = std::min(lookup_batch, keys.size() - base);
+    for (size_t i = 0; i < count; ++i) {
+      hashes[i] = hash_(keys[base + i]);
+      runs[i] = run_of(hashes[i]);
+      __builtin_prefetch(runs[i].first);
+    }
+    for (size_t i = 0; i < count; ++i) {
+      ListIterator first = *runs[i].first;
+      if (first != ListIterator()) {
+        __builtin_prefetch(std::to_address(first));
+      }
+    }
+    // a probe that passes the first node reads the next one's key; the
+    // last node's successor is the list's sentinel, which holds no key
+    for (size_t i = 0; i < count; ++i) {
+      ListIterator first = *runs[i].first;
+      if (first == ListIterator()) {
+        continue;
+      }
+      ListIterator next = std::next(first);
+      if (next != list_end()) {
+        __builtin_prefetch(std::to_address(next));
+      }
+    }
+    for (size_t i = 0; i < count; ++i) {
+      out[base + i] = It(find_in_run(keys[base + i], hashes[i], runs[i]));
+    }
+  }
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+typename UnorderedMap<Key, Value, Hash, Equal, Alloc>::Run
+UnorderedMap<Key, Value, Hash, Equal, Alloc>::run_of(size_t hash) const {
+  ListIterator end = list_end();
+  if (old_buckets_ != nullptr &&
+      (hash & (old_bucket_count_ - 1)) >= migrated_) {
+    size_t mask = old_bucket_count_ - 1;
+    return {old_buckets_ + (hash & mask), hash & mask, mask, end, true};
+  }
+  size_t mask = bucket_count_ - 1;
+  ListIterator stop = (old_begin_ == ListIterator() ? end : old_begin_);
+  return {buckets_ + (hash & mask), hash & mask, mask, stop, false};
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+template <typename K, typename... Args>
+std::pair<typename UnorderedMap<Key, Value, Hash, Equal, Alloc>::iterator, bool>
+UnorderedMap<Key, Value, Hash, Equal, Alloc>::emplace_key(size_t hash,
+                                                          K&& key,
+                                                          Args&&... args) {
+  ListIterator found = find_node(key, hash);
+  if (found != list_.end()) {
+    return {iterator(found), false};
+  }
+  auto link = [&](ListIterator pos) {
+    return list_.emplace(pos, hash, std::piecewise_construct,
+                         std::forward_as_tuple(std::forward<K>(key)),
+                         std::forward_as_tuple(std::forward<Args>(args)...));
+  };
+  grow_for_insert();
+  return {link_into_run(hash, link), true};
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+template <typename Link>
+typename UnorderedMap<Key, Value, Hash, Equal, Alloc>::iterator
+UnorderedMap<Key, Value, Hash, Equal, Alloc>::link_into_run(size_t hash,
+                                                            Link link) {
+  Run run = run_of(hash);
+  ListIterator& first = *run.first;
+  ListIterator pos = first;
+  if (pos == ListIterator()) {
+    // an empty old bucket starts its run at the head of the old nodes
+    pos = (!run.old                      ? list_.begin()
+           : old_begin_ == ListIterator() ? list_.end()
+                                          : old_begin_);
+  }
+  first = link(pos);
+  if (run.old && (old_begin_ == ListIterator() || pos == old_begin_)) {
+    old_begin_ = first;
+  }
+  return iterator(first);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc>::detach(ListIterator it) {
+  Run run = run_of(hash_of(it));
+  ListIterator next = std::next(it);
+  if (*run.first == it) {
+    *run.first = (in_run(run, next) ? next : ListIterator());
+  }
+  if (it == old_begin_) {
+    old_begin_ = (next == list_.end() ? ListIterator() : next);
+  }
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+typename UnorderedMap<Key, Value, Hash, Equal, Alloc>::ListIterator*
+UnorderedMap<Key, Value, Hash, Equal, Alloc>::allocate_buckets(size_t count) {
+  BucketAlloc alloc(list_.get_allocator());
+  ListIterator* buckets =
+      std::to_address(BucketTraits::allocate(alloc, count));
+  std::uninitialized_fill_n(buckets, count, ListIterator());
+  return buckets;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc>::deallocate_buckets() {
+  release_old_buckets();
+  if (bucket_count_ == 0) {
+    return;
+  }
+  BucketAlloc alloc(list_.get_allocator());
+  BucketTraits::deallocate(alloc, buckets_, bucket_count_);
+  buckets_ = nullptr;
+  bucket_count_ = 0;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc>::release_old_buckets() {
+  if (old_buckets_ == nullptr) {
+    return;
+  }
+  BucketAlloc alloc(list_.get_allocator());
+  BucketTraits::deallocate(alloc, old_buckets_, old_bucket_count_);
+  old_buckets_ = nullptr;
+  old_bucket_count_ = 0;
+  migrated_ = 0;
+  old_begin_ = ListIterator();
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc>::rebuild(size_t count) {
+  ListIterator* buckets = allocate_buckets(count);
+  deallocate_buckets();
+  buckets_ = buckets;
+  bucket_count_ = count;
+  // Splicing within one allocator relinks the nodes and cannot throw.
+  NodeList nodes(list_.get_allocator());
+  nodes.splice(nodes.end(), list_);
+  while (!nodes.empty()) {
+    ListIterator it = nodes.begin();
+    ListIterator& first = buckets_[bucket_of(hash_of(it))];
+    list_.splice(first == ListIterator() ? list_.begin() : first, nodes, it);
+    first = it;
+  }
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc>::grow_for_insert() {
+  float limit = static_cast<float>(bucket_count_) * max_load_factor_;
+  if (static_cast<float>(size() + 1) <= limit) {
+    migrate(migration_step(limit));
+    return;
+  }
+  // a no-op for insertions, migration_step has finished by now
+  finish_migration();
+  if (!incremental_ || bucket_count_ == 0) {
+    reserve(size() + 1);
+    return;
+  }
+  start_migration();
+  migrate(rehash_step);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+size_t UnorderedMap<Key, Value, Hash, Equal, Alloc>::migration_step(
+    float limit) const {
+  if (old_buckets_ == nullptr) {
+    return 0;
+  }
+  // at least one more insertion fits, erasures only add to the headroom
+  size_t headroom = static_cast<size_t>(limit) - size();
+  size_t remaining = old_bucket_count_ - migrated_;
+  return std::max(rehash_step, (remaining + headroom - 1) / headroom);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc>::start_migration() {
+  // The new buckets are constructed as their old buckets move, the
+  // allocation is the only cost that grows with the table.
+  BucketAlloc alloc(list_.get_allocator());
+  ListIterator* buckets =
+      std::to_address(BucketTraits::allocate(alloc, 2 * bucket_count_));
+  old_buckets_ = std::exchange(buckets_, buckets);
+  old_bucket_count_ = std::exchange(bucket_count_, 2 * bucket_count_);
+  migrated_ = 0;
+  old_begin_ = (list_.empty() ? ListIterator() : list_.begin());
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc>::migrate(size_t count) {
+  if (old_buckets_ == nullptr) {
+    return;
+  }
+  const size_t mask = old_bucket_count_ - 1;
+  for (; count > 0 && migrated_ < old_bucket_count_; --count, ++migrated_) {
+    size_t index = migrated_;
+    // doubling splits old bucket index into new buckets index and
+    // index + old_bucket_count_
+    std::construct_at(buckets_ + index);
+    std::construct_at(buckets_ + index + old_bucket_count_);
+    ListIterator it = old_buckets_[index];
+    while (it != ListIterator()) {
+      ListIterator next = std::next(it);
+      bool more = next != list_.end() && (hash_of(next) & mask) == index;
+      if (it == old_begin_) {
+        old_begin_ = (next == list_.end() ? ListIterator() : next);
+      }
+      ListIterator& first = buckets_[bucket_of(hash_of(it))];
+      list_.splice(first == ListIterator() ? list_.begin() : first, list_, it);
+      first = it;
+      it = (more ? next : ListIterator());
+    }
+  }
+  if (migrated_ == old_bucket_count_) {
+    release_old_buckets();
+  }
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+UnorderedMap<Key, Value, Hash, Equal, Alloc>::UnorderedMap(
+    size_t bucket_count, const Hash& hash, const Equal& equal,
+    const Alloc& alloc)
+    : hash_(hash),
+      equal_(equal),
+      list_(ElementAlloc(alloc)) {
+  rehash(bucket_count);
+}
+
+// The constructors below delegate, so that the destructor cleans up if
+// an insertion throws.
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+UnorderedMap<Key, Value, Hash, Equal, Alloc>::UnorderedMap(
+    std::initializer_list<value_type> values, const Alloc& alloc)
+    : UnorderedMap(values.size(), Hash(), Equal(), alloc) {
+  insert(values);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+UnorderedMap<Key, Value, Hash, Equal, Alloc>::UnorderedMap(
+    const UnorderedMap& another)
+    : UnorderedMap(another,
+                   ElementTraits::select_on_container_copy_construction(
+                       another.list_.get_allocator())) {
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+UnorderedMap<Key, Value, Hash, Equal, Alloc>::UnorderedMap(
+    const UnorderedMap& another, const Alloc& alloc)
+    : UnorderedMap(0, another.hash_, another.equal_, alloc) {
+  max_load_factor_ = another.max_load_factor_;
+  incremental_ = another.incremental_;
+  reserve(another.size());
+  insert(another.begin(), another.end());
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+UnorderedMap<Key, Value, Hash, Equal, Alloc>::UnorderedMap(
+    UnorderedMap&& another) noexcept
+    : hash_(std::move(another.hash_)),
+      equal_(std::move(another.equal_)),
+      list_(std::move(another.list_)),
+      buckets_(std::exchange(another.buckets_, nullptr)),
+      bucket_count_(std::exchange(another.bucket_count_, 0)),
+      max_load_factor_(another.max_load_factor_),
+      incremental_(another.incremental_),
+      old_buckets_(std::exchange(another.old_buckets_, nullptr)),
+      old_bucket_count_(std::exchange(another.old_bucket_count_, 0)),
+      migrated_(std::exchange(another.migrated_, 0)),
+      old_begin_(std::exchange(another.old_begin_, ListIterator())) {
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+UnorderedMap<Key, Value, Hash, Equal, Alloc>&
+UnorderedMap<Key, Value, Hash, Equal, Alloc>::operator=(
+    const UnorderedMap& another) {
+  if (this == &another) {
+    return *this;
+  }
+  constexpr bool propagate =
+      ElementTraits::propagate_on_container_copy_assignment::value;
+  UnorderedMap copy(another, propagate ? another.get_allocator()
+                                       : get_allocator());
+  *this = std::move(copy);
+  return *this;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+UnorderedMap<Key, Value, Hash, Equal, Alloc>&
+UnorderedMap<Key, Value, Hash, Equal, Alloc>::operator=(
+    UnorderedMap&& another) noexcept(
+    std::allocator_traits<Alloc>::propagate_on_container_move_assignment::
+        value ||
+    std::allocator_traits<Alloc>::is_always_equal::value) {
+  if (this == &another) {
+    return *this;
+  }
+  constexpr bool propagate =
+      ElementTraits::propagate_on_container_move_assignment::value;
+  hash_ = std::move(another.hash_);
+  equal_ = std::move(another.equal_);
+  max_load_factor_ = another.max_load_factor_;
+  incremental_ = another.incremental_;
+  if (propagate || list_.get_allocator() == another.list_.get_allocator()) {
+    // the buckets go back before the list can adopt another allocator
+    deallocate_buckets();
+    list_ = std::move(another.list_);
+    buckets_ = std::exchange(another.buckets_, nullptr);
+    bucket_count_ = std::exchange(another.bucket_count_, 0);
+    old_buckets_ = std::exchange(another.old_buckets_, nullptr);
+    old_bucket_count_ = std::exchange(another.old_bucket_count_, 0);
+    migrated_ = std::exchange(another.migrated_, 0);
+    old_begin_ = std::exchange(another.old_begin_, ListIterator());
+    return *this;
+  }
+  // the nodes belong to the other allocator: move element by element
+  clear();
+  reserve(another.size());
+  for (auto& [key, value] : another) {
+    emplace_key(hash_(key), std::move(const_cast<Key&>(key)),
+                std::move(value));
+  }
+  another.clear();
+  return *this;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+Value& UnorderedMap<Key, Value, Hash, Equal, Alloc>::at(const Key& key) {
+  iterator it = find(key);
+  if (it == end()) {
+    throw std::out_of_range("UnorderedMap::at: no such key");
+  }
+  return it->second;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+const Value& UnorderedMap<Key, Value, Hash, Equal, Alloc>::at(
+    const Key& key) const {
+  return const_cast<UnorderedMap*>(this)->at(key);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+typename UnorderedMap<Key, Value, Hash, Equal, Alloc>::iterator
+UnorderedMap<Key, Value, Hash, Equal, Alloc>::erase(const_iterator pos) {
+  // no migration here: the remaining elements keep their order
+  detach(pos.it_);
+  return iterator(list_.erase(pos.it_));
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+typename UnorderedMap<Key, Value, Hash, Equal, Alloc>::iterator
+UnorderedMap<Key, Value, Hash, Equal, Alloc>::erase(const_iterator first,
+                                                    const_iterator last) {
+  while (first != last) {
+    first = erase(first);
+  }
+  return iterator(last.it_);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+template <typename K>
+size_t UnorderedMap<Key, Value, Hash, Equal, Alloc>::erase_key(const K& key,
+                                                              size_t hash) {
+  ListIterator it = find_node(key, hash);
+  if (it == list_.end()) {
+    return 0;
+  }
+  erase(const_iterator(it));
+  return 1;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+template <typename K>
+typename UnorderedMap<Key, Value, Hash, Equal, Alloc>::node_type
+UnorderedMap<Key, Value, Hash, Equal, Alloc>::extract_key(const K& key) {
+  ListIterator it = find_node(key, hash_(key));
+  if (it == list_.end()) {
+    return node_type();
+  }
+  return extract(const_iterator(it));
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+typename UnorderedMap<Key, Value, Hash, Equal, Alloc>::insert_return_type
+UnorderedMap<Key, Value, Hash, Equal, Alloc>::insert(node_type&& node) {
+  if (node.empty()) {
+    return {end(), false, node_type()};
+  }
+  size_t hash = hash_(node.key());
+  ListIterator found = find_node(node.key(), hash);
+  if (found != list_.end()) {
+    return {iterator(found), false, std::move(node)};
+  }
+  if constexpr (cache_hash) {
+    node.handle_.value().hash = hash;
+  }
+  auto link = [this, &node](ListIterator pos) {
+    return list_.insert(pos, std::move(node.handle_));
+  };
+  grow_for_insert();
+  return {link_into_run(hash, link), true, node_type()};
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc>::merge(UnorderedMap& source) {
+  if (this == &source) {
+    return;
+  }
+  for (ListIterator it = source.list_.begin(); it != source.list_.end();) {
+    ListIterator next = std::next(it);
+    // source may hash differently, the stored hash is not reused
+    size_t hash = hash_(it->value.first);
+    if (find_node(it->value.first, hash) == list_.end()) {
+      // the only step that can throw comes before the node leaves source
+      grow_for_insert();
+      source.detach(it);
+      auto handle = source.list_.extract(it);
+      if constexpr (cache_hash) {
+        handle.value().hash = hash;
+      }
+      auto link = [this, &handle](ListIterator pos) {
+        return list_.insert(pos, std::move(handle));
+      };
+      link_into_run(hash, link);
+    }
+    it = next;
+  }
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc>::clear() {
+  list_.clear();
+  if constexpr (drops_nodes) {
+    deallocate_buckets();
+  } else {
+    // after a migration not every bucket has been constructed yet
+    release_old_buckets();
+    std::uninitialized_fill_n(buckets_, bucket_count_, ListIterator());
+  }
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc>::reserve(size_t count) {
+  auto buckets = static_cast<float>(count) / max_load_factor_;
+  if (buckets > static_cast<float>(bucket_count_)) {
+    rehash(static_cast<size_t>(std::ceil(buckets)));
+  }
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc>::rehash(size_t count) {
+  finish_migration();
+  if (count == 0 && bucket_count_ == 0) {
+    return;
+  }
+  size_t buckets = min_bucket_count;
+  while (buckets < count || static_cast<float>(buckets) * max_load_factor_ <
+                                static_cast<float>(size())) {
+    buckets *= 2;
+  }
+  if (buckets != bucket_count_) {
+    rebuild(buckets);
+  }
+}
+
+template <typename Key, typename Value, typename Hash, typename Equal,
+          typename Alloc>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc>::swap(
+    UnorderedMap& another) noexcept {
+  using std::swap;
+  swap(hash_, another.hash_);
+  swap(equal_, another.equal_);
+  list_.swap(another.list_);
+  swap(buckets_, another.buckets_);
+  swap(bucket_count_, another.bucket_count_);
+  swap(max_load_factor_, another.max_load_factor_);
+  swap(incremental_, another.incremental_);
+  swap(old_buckets_, another.old_buckets_);
+  swap(old_bucket_count_, another.old_bucket_count_);
+  swap(migrated_, another.migrated_);
+  swap(old_begin_, another.old_begin_);
+}
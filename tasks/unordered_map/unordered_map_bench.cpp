@@ -0,0 +1,317 @@
+// Timing harness for UnorderedMap. Correctness lives in
+// unordered_map_test.cpp; this binary only measures.
+//
+//   unordered_map_bench [--warmup N] [--repetitions M] [--elements K]
+//                       [--operations O] [--threads T]
+//                       [--filter SUBSTRING] [--json PATH]
+//
+// grow inserts K random keys into an empty map and times every insertion,
+// so its percentiles are over single insertions from all measured
+// repetitions and a stop-the-world rehash shows up in the tail.
+//
+// mixed runs O operations, 7 in 8 lookups and the rest insertions and
+// erasures, on 1, 2, 4, ... up to T threads sharing one UnorderedMap
+// behind a std::mutex or one ConcurrentUnorderedMap. Its percentiles are
+// over repetitions of the wall time divided by O, so perfect scaling
+// halves it with every doubling of the threads.
+//
+// A table goes to stderr, JSON to stdout or PATH.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "concurrent_unordered_map.h"
+#include "unordered_map.h"
+
+namespace {
+
+struct Options {
+  int warmup = 1;
+  int repetitions = 5;
+  size_t elements = 1'000'000;
+  size_t operations = 2'000'000;
+  int threads = static_cast<int>(
+      std::max(4u, std::min(16u, std::thread::hardware_concurrency())));
+  std::string filter;
+  std::string json;
+};
+
+struct Result {
+  std::string map;
+  std::string workload;
+  // Nanoseconds per operation, sorted.
+  std::vector<double> samples;
+
+  // Nearest-rank percentile of the samples.
+  double percentile(double fraction) const;
+};
+
+double Result::percentile(double fraction) const {
+  if (samples.empty()) {
+    return 0;
+  }
+  auto rank =
+      static_cast<size_t>(fraction * static_cast<double>(samples.size()));
+  return samples[std::min(rank, samples.size() - 1)];
+}
+
+size_t volatile sink = 0;
+
+// Inserts count random keys into map and times each insertion.
+template <typename Map>
+size_t grow(Map& map, size_t count, std::vector<double>& latencies) {
+  std::mt19937_64 gen(3);
+  for (size_t i = 0; i < count; ++i) {
+    uint64_t key = gen();
+    auto start = std::chrono::steady_clock::now();
+    map[key] = key;
+    auto finish = std::chrono::steady_clock::now();
+    latencies.push_back(
+        std::chrono::duration<double, std::nano>(finish - start).count());
+  }
+  return map.size();
+}
+
+// Keys of the mixed workload, of which the even ones are present at the
+// start.
+const int key_range = 1 << 20;
+
+struct LockedMap {
+  static constexpr const char* name = "UnorderedMap+std::mutex";
+
+  UnorderedMap<int, int> map;
+  std::mutex mutex;
+
+  bool find(int key) {
+    std::lock_guard lock(mutex);
+    return map.contains(key);
+  }
+  void insert(int key) {
+    std::lock_guard lock(mutex);
+    map[key] = key;
+  }
+  void erase(int key) {
+    std::lock_guard lock(mutex);
+    map.erase(key);
+  }
+};
+
+struct ShardedMap {
+  static constexpr const char* name = "ConcurrentUnorderedMap";
+
+  ConcurrentUnorderedMap<int, int> map;
+
+  bool find(int key) {
+    return map.contains(key);
+  }
+  void insert(int key) {
+    map.insert_or_assign(key, key);
+  }
+  void erase(int key) {
+    map.erase(key);
+  }
+};
+
+// Spreads count operations over threads that start together and returns
+// the wall time in nanoseconds.
+template <typename Map>
+double run_mixed(Map& map, size_t count, int threads) {
+  std::atomic<int> ready = 0;
+  std::atomic<bool> go = false;
+  std::atomic<size_t> found = 0;
+  size_t per_thread = count / static_cast<size_t>(threads);
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&map, &ready, &go, &found, per_thread, t] {
+      std::mt19937_64 gen(t);
+      size_t hits = 0;
+      ready.fetch_add(1);
+      while (!go.load()) {
+        std::this_thread::yield();
+      }
+      for (size_t i = 0; i < per_thread; ++i) {
+        uint64_t random = gen();
+        int key = static_cast<int>(random % key_range);
+        switch (random >> 60) {
+          case 0:
+            map.insert(key);
+            break;
+          case 1:
+            map.erase(key);
+            break;
+          default:
+            hits += static_cast<size_t>(map.find(key));
+        }
+      }
+      found.fetch_add(hits);
+    });
+  }
+  while (ready.load() != threads) {
+    std::this_thread::yield();
+  }
+  auto start = std::chrono::steady_clock::now();
+  go.store(true);
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  auto finish = std::chrono::steady_clock::now();
+  sink = sink + found.load();
+  return std::chrono::duration<double, std::nano>(finish - start).count();
+}
+
+void report(const Result& result) {
+  std::cerr << "  " << result.map << " / " << result.workload << ": p50 "
+            << result.percentile(0.5) << " ns, p99 "
+            << result.percentile(0.99) << " ns, p99.9 "
+            << result.percentile(0.999) << " ns, p99.999 "
+            << result.percentile(0.99999) << " ns, max "
+            << result.percentile(1.0) << " ns" << std::endl;
+}
+
+template <typename MakeMap>
+void measure_growth(const std::string& map_name, const std::string& workload,
+                    const Options& options, const MakeMap& make,
+                    std::vector<Result>& results) {
+  std::string tag = map_name + "/" + workload;
+  if (tag.find(options.filter) == std::string::npos) {
+    return;
+  }
+
+  Result result{map_name, workload, {}};
+  result.samples.reserve(static_cast<size_t>(options.repetitions) *
+                         options.elements);
+  std::vector<double> latencies;
+  latencies.reserve(options.elements);
+  for (int i = 0; i < options.warmup + options.repetitions; ++i) {
+    latencies.clear();
+    auto map = make();
+    sink = sink + grow(map, options.elements, latencies);
+    if (i >= options.warmup) {
+      result.samples.insert(result.samples.end(), latencies.begin(),
+                            latencies.end());
+    }
+  }
+  std::sort(result.samples.begin(), result.samples.end());
+  report(result);
+  results.push_back(std::move(result));
+}
+
+template <typename Map>
+void measure_mixed(const Options& options, std::vector<Result>& results) {
+  for (int threads = 1; threads <= options.threads; threads *= 2) {
+    std::string workload = "mixed/" + std::to_string(threads);
+    std::string tag = std::string(Map::name) + "/" + workload;
+    if (tag.find(options.filter) == std::string::npos) {
+      continue;
+    }
+
+    Result result{Map::name, workload, {}};
+    for (int i = 0; i < options.warmup + options.repetitions; ++i) {
+      // the mutex cannot move
+      auto map = std::make_unique<Map>();
+      for (int key = 0; key < key_range; key += 2) {
+        map->insert(key);
+      }
+      double nanos = run_mixed(*map, options.operations, threads);
+      if (i >= options.warmup) {
+        result.samples.push_back(nanos /
+                                 static_cast<double>(options.operations));
+      }
+    }
+    std::sort(result.samples.begin(), result.samples.end());
+    report(result);
+    results.push_back(std::move(result));
+  }
+}
+
+void write_json(std::ostream& out, const Options& options,
+                const std::vector<Result>& results) {
+  out << "{\n  \"elements\": " << options.elements
+      << ",\n  \"operations\": " << options.operations
+      << ",\n  \"warmup\": " << options.warmup
+      << ",\n  \"repetitions\": " << options.repetitions
+      << ",\n  \"results\": [";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result& result = results[i];
+    out << (i == 0 ? "\n" : ",\n") << "    {\"map\": \"" << result.map
+        << "\", \"workload\": \"" << result.workload
+        << "\", \"p50_ns\": " << result.percentile(0.5)
+        << ", \"p99_ns\": " << result.percentile(0.99)
+        << ", \"p99_9_ns\": " << result.percentile(0.999)
+        << ", \"p99_999_ns\": " << result.percentile(0.99999)
+        << ", \"max_ns\": " << result.percentile(1.0) << "}";
+  }
+  out << "\n  ]\n}\n";
+}
+
+Options parse_options(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; i += 2) {
+    std::string key = argv[i];
+    if (i + 1 == argc) {
+      throw std::invalid_argument("option " + key + " expects a value");
+    }
+    std::string value = argv[i + 1];
+    if (key == "--warmup") {
+      options.warmup = std::stoi(value);
+    } else if (key == "--repetitions") {
+      options.repetitions = std::max(1, std::stoi(value));
+    } else if (key == "--elements") {
+      options.elements = std::max<size_t>(1, std::stoul(value));
+    } else if (key == "--operations") {
+      options.operations = std::max<size_t>(1, std::stoul(value));
+    } else if (key == "--threads") {
+      options.threads = std::max(1, std::stoi(value));
+    } else if (key == "--filter") {
+      options.filter = value;
+    } else if (key == "--json") {
+      options.json = value;
+    } else {
+      throw std::invalid_argument("unknown option " + key);
+    }
+  }
+  return options;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options = parse_options(argc, argv);
+
+  std::vector<Result> results;
+  measure_growth(
+      "std::unordered_map", "grow", options,
+      [] { return std::unordered_map<uint64_t, uint64_t>(); }, results);
+  measure_growth(
+      "UnorderedMap", "grow", options,
+      [] { return UnorderedMap<uint64_t, uint64_t>(); }, results);
+  measure_growth(
+      "UnorderedMap", "grow_incremental", options,
+      [] {
+        UnorderedMap<uint64_t, uint64_t> map;
+        map.incremental_rehash(true);
+        return map;
+      },
+      results);
+  measure_mixed<LockedMap>(options, results);
+  measure_mixed<ShardedMap>(options, results);
+
+  if (options.json.empty()) {
+    write_json(std::cout, options, results);
+  } else {
+    std::ofstream out(options.json);
+    write_json(out, options, results);
+  }
+}
@@ -0,0 +1,898 @@
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "concurrent_unordered_map.h"
+#include "flat_unordered_map.h"
+#include "unordered_map.h"
+#include "../list/stackallocator.h"
+
+#ifndef NO_TEST
+
+// NOLINTBEGIN
+
+std::atomic<size_t> new_calls = 0;
+
+void* operator new(size_t bytes) {
+    ++new_calls;
+    void* ptr = std::malloc(bytes == 0 ? 1 : bytes);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+struct Accountant {
+    static int alive;
+
+    int value;
+
+    Accountant(int value = 0) : value(value) {
+        ++alive;
+    }
+    Accountant(const Accountant& another) : value(another.value) {
+        ++alive;
+    }
+    Accountant(Accountant&& another) noexcept : value(another.value) {
+        ++alive;
+    }
+    Accountant& operator=(const Accountant&) = default;
+    ~Accountant() {
+        --alive;
+    }
+};
+
+int Accountant::alive = 0;
+
+struct NotDefaultConstructible {
+    int value;
+
+    NotDefaultConstructible(int value) : value(value) {}
+};
+
+// Every key lands in the same few groups.
+struct BadHash {
+    size_t operator()(int key) const {
+        return static_cast<size_t>(key % 4) << 7 | static_cast<size_t>(key % 3);
+    }
+};
+
+template <template <typename...> class Map>
+void TestBasics() {
+    Map<std::string, int> map;
+    assert(map.empty() && map.find("a") == map.end() && !map.contains("a"));
+
+    map["one"] = 1;
+    map.insert({"two", 2});
+    auto [it, inserted] = map.emplace("three", 3);
+    assert(inserted && it->second == 3);
+    assert(!map.emplace("three", 33).second && map.at("three") == 3);
+    assert(!map.try_emplace("one", 11).second && map["one"] == 1);
+    assert(map.size() == 3 && map.count("two") == 1);
+
+    try {
+        map.at("four");
+        assert(false);
+    } catch (const std::out_of_range&) {
+    }
+
+    int sum = 0;
+    for (const auto& [key, value]: map) {
+        sum += value;
+    }
+    assert(sum == 6);
+
+    assert(map.erase("two") == 1 && map.erase("two") == 0);
+    auto next = map.erase(map.find("one"));
+    assert(map.size() == 1 && (next == map.end() || next->first == "three"));
+
+    Map<int, NotDefaultConstructible> special;
+    special.try_emplace(1, 10);
+    special.emplace(2, 20);
+    assert(special.at(1).value == 10 && special.find(2)->second.value == 20);
+
+    Map<int, std::unique_ptr<int>> move_only;
+    for (int i = 0; i < 100; ++i) {
+        move_only.try_emplace(i, std::make_unique<int>(i));
+    }
+    assert(*move_only.at(99) == 99);
+
+    const auto& constant = map;
+    assert(constant.find("three")->second == 3 && constant.at("three") == 3);
+}
+
+// Random operations checked against std::unordered_map, with a bad hash
+// to force long probe sequences and many deleted slots.
+template <typename Map>
+void CompareWithStd(int operations, int key_range, Map map = Map()) {
+    std::unordered_map<int, int> expected;
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<int> key(0, key_range);
+    for (int i = 0; i < operations; ++i) {
+        int k = key(gen);
+        switch (gen() % 4) {
+            case 0:
+            case 1:
+                map[k] = i;
+                expected[k] = i;
+                break;
+            case 2:
+                assert(map.erase(k) == expected.erase(k));
+                break;
+            default: {
+                auto it = map.find(k);
+                auto expected_it = expected.find(k);
+                assert((it == map.end()) == (expected_it == expected.end()));
+                assert(it == map.end() || it->second == expected_it->second);
+            }
+        }
+        assert(map.size() == expected.size());
+    }
+    size_t visited = 0;
+    for (const auto& [k, v]: map) {
+        assert(expected.at(k) == v);
+        ++visited;
+    }
+    assert(visited == expected.size());
+}
+
+void TestFlatGrowthAndErase() {
+    CompareWithStd<FlatUnorderedMap<int, int>>(200'000, 5'000);
+    CompareWithStd<FlatUnorderedMap<int, int, BadHash>>(20'000, 500);
+
+    // erasing everything and inserting again does not grow the table
+    FlatUnorderedMap<int, int> map;
+    for (int i = 0; i < 1000; ++i) {
+        map[i] = i;
+    }
+    size_t buckets = map.bucket_count();
+    for (int round = 0; round < 20; ++round) {
+        for (int i = 0; i < 1000; ++i) {
+            assert(map.erase(i) == 1);
+        }
+        assert(map.empty());
+        for (int i = 0; i < 1000; ++i) {
+            map[i] = round;
+        }
+    }
+    assert(map.bucket_count() == buckets && map.load_factor() <= map.max_load_factor());
+
+    map.reserve(100'000);
+    assert(map.bucket_count() * 7 / 8 >= 100'000 && map.at(999) == 19);
+    map.clear();
+    assert(map.empty() && map.begin() == map.end() && map.bucket_count() >= 100'000);
+}
+
+template <template <typename...> class Map>
+void TestCopyMoveAndAllocator() {
+    Accountant::alive = 0;
+    {
+        Map<int, Accountant> map;
+        for (int i = 0; i < 1000; ++i) {
+            map.try_emplace(i, i);
+        }
+        assert(Accountant::alive == 1000);
+
+        auto copy = map;
+        assert(Accountant::alive == 2000 && copy.at(500).value == 500);
+        auto moved = std::move(copy);
+        assert(Accountant::alive == 2000 && copy.empty() && moved.size() == 1000);
+
+        copy = moved;
+        map = std::move(moved);
+        assert(Accountant::alive == 2000 && map.size() == 1000);
+        map.swap(copy);
+        copy.erase(1);
+        assert(Accountant::alive == 1999 && copy.size() == 999);
+    }
+    assert(Accountant::alive == 0);
+
+    StackStorage<1'000'000, StackStats> storage;
+    using Alloc = StackAllocator<std::pair<const int, int>, 1'000'000, StackStats>;
+    {
+        Map<int, int, std::hash<int>, std::equal_to<int>, Alloc> map{Alloc(storage)};
+        for (int i = 0; i < 10'000; ++i) {
+            map[i] = -i;
+        }
+        assert(map.at(9'999) == -9'999 && storage.stats().allocations > 0);
+    }
+}
+
+void CompareFlatPerformance() {
+    using namespace std::chrono;
+
+    const int size = 1'000'000;
+    std::vector<uint64_t> keys(size);
+    std::mt19937_64 gen(42);
+    for (auto& key: keys) {
+        key = gen();
+    }
+    std::vector<uint64_t> probes = keys;
+    std::shuffle(probes.begin(), probes.end(), gen);
+
+    FlatUnorderedMap<uint64_t, uint64_t> flat;
+    std::unordered_map<uint64_t, uint64_t> standard;
+    auto start = high_resolution_clock::now();
+    for (auto key: keys) {
+        flat[key] = key;
+    }
+    auto flat_insert = duration_cast<milliseconds>(high_resolution_clock::now() - start).count();
+    start = high_resolution_clock::now();
+    for (auto key: keys) {
+        standard[key] = key;
+    }
+    auto std_insert = duration_cast<milliseconds>(high_resolution_clock::now() - start).count();
+
+    auto measure = [&probes](const auto& map, uint64_t flip) {
+        uint64_t found = 0;
+        auto start = high_resolution_clock::now();
+        for (int round = 0; round < 3; ++round) {
+            for (auto key: probes) {
+                found += map.count(key ^ flip);
+            }
+        }
+        auto time = duration_cast<milliseconds>(high_resolution_clock::now() - start).count();
+        assert(found == (flip == 0 ? 3 * probes.size() : 0));
+        return time;
+    };
+    auto flat_hits = measure(flat, 0);
+    auto std_hits = measure(standard, 0);
+    auto flat_misses = measure(flat, 1ULL << 63);
+    auto std_misses = measure(standard, 1ULL << 63);
+
+    // timings only: a shared runner is too noisy to fail the correctness run on them
+    auto ratio = [](long long std_time, long long flat_time) {
+        return static_cast<double>(std_time) / static_cast<double>(std::max(flat_time, 1LL));
+    };
+    std::cerr << " 1M keys: insert " << flat_insert << " ms FlatUnorderedMap, " << std_insert
+            << " ms std::unordered_map; 3M hits " << flat_hits << " ms / " << std_hits << " ms; 3M misses "
+            << flat_misses << " ms / " << std_misses << " ms" << std::endl;
+    std::cerr << " FlatUnorderedMap speedup: insert " << ratio(std_insert, flat_insert) << "x, hits "
+            << ratio(std_hits, flat_hits) << "x, misses " << ratio(std_misses, flat_misses) << "x" << std::endl;
+}
+
+void TestNodeStabilityAndArena() {
+    CompareWithStd<UnorderedMap<int, int>>(200'000, 5'000);
+    CompareWithStd<UnorderedMap<int, int, BadHash>>(20'000, 500);
+
+    // references and iterators survive rehashing
+    UnorderedMap<int, std::string> map;
+    map[0] = "zero";
+    std::string* zero = &map.at(0);
+    auto it = map.find(0);
+    for (int i = 1; i < 100'000; ++i) {
+        map[i] = std::to_string(i);
+    }
+    map.rehash(1 << 20);
+    assert(zero == &map.at(0) && it->second == "zero" && map.bucket_count() >= (1 << 20));
+    assert(map.load_factor() <= map.max_load_factor());
+    map.max_load_factor(4.0F);
+    map.rehash(0);
+    assert(map.bucket_count() * 4 >= map.size() && map.bucket_count() < 100'000);
+    assert(zero == &map.at(0) && map.at(99'999) == "99999");
+
+    // erasing while iterating
+    for (auto current = map.begin(); current != map.end();) {
+        current = (current->first % 2 == 0 ? map.erase(current) : std::next(current));
+    }
+    assert(map.size() == 50'000 && !map.contains(0) && map.at(1) == "1");
+    map.erase(map.begin(), map.end());
+    assert(map.empty() && map.bucket_count() > 0);
+
+    // short-lived maps on one storage give their memory back
+    using Storage = StackStorage<10'000'000>;
+    auto storage = std::unique_ptr<Storage>(new Storage);
+    using PlainAlloc = StackAllocator<std::pair<const int, int>, 10'000'000>;
+    for (int i = 0; i < 1000; ++i) {
+        UnorderedMap<int, int, std::hash<int>, std::equal_to<int>, PlainAlloc> tmp{PlainAlloc(*storage)};
+        tmp[i] = i;
+    }
+    assert(storage->used() == 0);
+
+    // an arena-backed map leaves its nodes to the storage
+    using Alloc = StackArenaAllocator<std::pair<const int, int>, 10'000'000>;
+    {
+        UnorderedMap<int, int, std::hash<int>, std::equal_to<int>, Alloc> arena_map{Alloc(*storage)};
+        for (int i = 0; i < 100'000; ++i) {
+            arena_map[i] = i;
+        }
+        size_t used = storage->used();
+        arena_map.clear();
+        assert(arena_map.empty() && arena_map.bucket_count() == 0 && storage->used() == used);
+        arena_map[1] = 1;
+        assert(arena_map.at(1) == 1 && arena_map.size() == 1);
+    }
+
+    // elements with a destructor are still destroyed
+    using AccountantAlloc = StackArenaAllocator<std::pair<const int, Accountant>, 10'000'000>;
+    Accountant::alive = 0;
+    {
+        UnorderedMap<int, Accountant, std::hash<int>, std::equal_to<int>, AccountantAlloc> arena_map{
+                AccountantAlloc(*storage)};
+        for (int i = 0; i < 1000; ++i) {
+            arena_map.try_emplace(i, i);
+        }
+        arena_map.clear();
+        assert(Accountant::alive == 0 && arena_map.bucket_count() > 0);
+        arena_map.try_emplace(1, 1);
+    }
+    assert(Accountant::alive == 0);
+}
+
+struct StringHash {
+    using is_transparent = void;
+
+    size_t operator()(std::string_view key) const {
+        return std::hash<std::string_view>()(key);
+    }
+};
+
+void TestHeterogeneousLookup() {
+    UnorderedMap<std::string, int, StringHash, std::equal_to<>> map;
+    std::string long_key(100, 'x');
+    map[long_key] = 1;
+    map["short"] = 2;
+
+    std::string buffer = "GET " + long_key + " HTTP/1.1";
+    std::string_view slice = std::string_view(buffer).substr(4, 100);
+    size_t before = new_calls;
+    assert(map.find(slice)->second == 1 && map.contains(slice) && map.count(slice) == 1);
+    auto [first, last] = map.equal_range(slice);
+    assert(first->second == 1 && std::next(first) == last);
+    assert(!map.try_emplace(slice, 5).second && map.find(slice)->second == 1);
+    const auto& constant = map;
+    assert(constant.find(std::string_view("short"))->second == 2);
+    auto [none, none_end] = constant.equal_range(std::string_view("none"));
+    assert(none == constant.end() && none_end == constant.end());
+    assert(map.erase(std::string_view("none")) == 0 && !map.contains("none"));
+    assert(new_calls == before);
+
+    assert(map.erase(slice) == 1 && !map.contains(slice) && map.size() == 1);
+    auto [it, inserted] = map.try_emplace(slice, 3);
+    assert(inserted && it->first == long_key && map.at(long_key) == 3);
+    map.erase(map.find(slice));
+    assert(map.size() == 1);
+
+    // without transparent functors the key is converted as before
+    UnorderedMap<std::string, int> plain;
+    plain["a"] = 1;
+    assert(plain.find("a") != plain.end() && plain.equal_range("a").first->second == 1);
+    assert(plain.erase("a") == 1 && plain.empty());
+}
+
+void TestIncrementalRehash() {
+    UnorderedMap<int, int> incremental;
+    incremental.incremental_rehash(true);
+    CompareWithStd(200'000, 50'000, std::move(incremental));
+    UnorderedMap<int, int, BadHash> bad;
+    bad.incremental_rehash(true);
+    CompareWithStd(20'000, 500, std::move(bad));
+    // a low load factor moves more buckets per insertion
+    UnorderedMap<int, int> sparse;
+    sparse.max_load_factor(0.05F);
+    sparse.incremental_rehash(true);
+    CompareWithStd(20'000, 5'000, std::move(sparse));
+    UnorderedMap<int, int> growing;
+    growing.max_load_factor(0.05F);
+    growing.incremental_rehash(true);
+    for (int i = 0; i < 20'000; ++i) {
+        size_t buckets = growing.bucket_count();
+        bool was_migrating = growing.migrating();
+        growing[i] = i;
+        // a migration is over before the table fills up again
+        assert(growing.bucket_count() == buckets || !was_migrating);
+    }
+
+    UnorderedMap<int, std::string> map;
+    map.incremental_rehash(true);
+    map[0] = "zero";
+    std::string* zero = &map.at(0);
+    bool migrated = false;
+    for (int i = 1; i < 10'000; ++i) {
+        map[i] = std::to_string(i);
+        migrated = migrated || map.migrating();
+        assert(map.load_factor() <= map.max_load_factor());
+    }
+    assert(migrated && zero == &map.at(0));
+
+    // grow once more and stop in the middle of the migration
+    while (!map.migrating()) {
+        map[static_cast<int>(map.size())] = "x";
+    }
+    map[-1] = "minus one";
+    assert(map.migrating() && map.at(-1) == "minus one");
+    size_t size = map.size();
+    size_t visited = 0;
+    for (const auto& [key, value]: map) {
+        assert(map.find(key) != map.end() && &map.at(key) == &value);
+        ++visited;
+    }
+    assert(visited == size);
+
+    auto copy = map;
+    assert(copy.size() == size && copy.at(9'999) == "9999");
+    for (int i = 0; i < 10'000; i += 2) {
+        assert(map.erase(i) == 1);
+    }
+    assert(map.migrating() && map.size() == size - 5'000 && map.at(1) == "1" && !map.contains(2));
+    for (auto it = map.begin(); it != map.end();) {
+        it = (it->first % 3 == 0 ? map.erase(it) : std::next(it));
+    }
+    assert(!map.contains(3) && map.at(5) == "5");
+
+    auto moved = std::move(map);
+    UnorderedMap<int, std::string> other;
+    other.swap(moved);
+    assert(other.migrating() && other.at(7) == "7" && moved.empty());
+    other.incremental_rehash(false);
+    assert(!other.migrating() && other.at(7) == "7");
+
+    copy.clear();
+    assert(copy.empty() && !copy.migrating() && copy.find(1) == copy.end());
+    copy[1] = "one";
+    assert(copy.at(1) == "one");
+}
+
+void TestConcurrentUnorderedMap() {
+    ConcurrentUnorderedMap<int, std::string> single(1);
+    assert(single.shard_count() == 1 && single.empty());
+    assert(single.insert_or_assign(1, "one") && !single.insert_or_assign(1, std::string("uno")));
+    assert(single.find(1) == "uno" && !single.find(2) && single.erase(1) == 1 && single.empty());
+    assert((ConcurrentUnorderedMap<int, int>(5).shard_count() == 8));
+
+    ConcurrentUnorderedMap<int, int> map;
+    const int writers = 4;
+    const int per_writer = 20'000;
+    std::atomic<bool> done = false;
+    std::vector<std::thread> threads;
+    for (int w = 0; w < writers; ++w) {
+        threads.emplace_back([&map, w] {
+            for (int i = w; i < writers * per_writer; i += writers) {
+                assert(map.insert_or_assign(i, -i));
+                assert(map.visit(i, [i](int& value) { value = i; }));
+            }
+        });
+    }
+    threads.emplace_back([&] {
+        std::mt19937 gen(5);
+        while (!done) {
+            int key = static_cast<int>(gen() % (writers * per_writer));
+            if (auto value = map.find(key)) {
+                assert(*value == key || *value == -key);
+            }
+        }
+    });
+    for (int w = 0; w < writers; ++w) {
+        threads[w].join();
+    }
+    done = true;
+    threads.back().join();
+    assert(map.size() == static_cast<size_t>(writers * per_writer));
+
+    std::atomic<int64_t> sum = 0;
+    map.for_each([&sum](const auto& value) {
+        assert(value.first == value.second);
+        sum.fetch_add(value.second, std::memory_order_relaxed);
+    }, 3);
+    int64_t total = writers * per_writer;
+    assert(sum == total * (total - 1) / 2);
+
+    for (int i = 0; i < total; i += 2) {
+        assert(map.erase(i) == 1);
+    }
+    assert(map.erase(0) == 0 && !map.contains(0) && map.contains(1));
+    assert(!map.cvisit(2, [](int) {}) && map.size() == static_cast<size_t>(total / 2));
+    map.clear();
+    assert(map.empty() && !map.find(1));
+}
+
+void TestFindMany() {
+    UnorderedMap<int, int> map;
+    std::vector<int> keys(100);
+    std::vector<UnorderedMap<int, int>::iterator> found(keys.size());
+    std::iota(keys.begin(), keys.end(), -50);
+    map.find_many(keys, found);
+    assert(std::all_of(found.begin(), found.end(), [&map](auto it) { return it == map.end(); }));
+
+    map.incremental_rehash(true);
+    // stop in the middle of a migration
+    int size = 0;
+    for (; size < 5'000 || !map.migrating(); ++size) {
+        map[size] = size * size;
+    }
+    keys.resize(1'000);
+    std::mt19937 gen(9);
+    for (int& key : keys) {
+        key = static_cast<int>(gen() % 10'000);
+    }
+    found.resize(keys.size());
+    map.find_many(keys, found);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        assert(found[i] == map.find(keys[i]));
+        assert(keys[i] >= size || found[i]->second == keys[i] * keys[i]);
+    }
+
+    const auto& const_map = map;
+    std::vector<UnorderedMap<int, int>::const_iterator> const_found(keys.size() - 1);
+    try {
+        const_map.find_many(keys, const_found);
+        assert(false);
+    } catch (const std::invalid_argument&) {
+    }
+    const_map.find_many(std::span(keys).subspan(1), const_found);
+    assert(const_found[0] == const_map.find(keys[1]));
+}
+
+// Lookups of random keys in a table far bigger than the last level cache,
+// one find at a time and through find_many.
+void CompareBatchedLookup() {
+    using namespace std::chrono;
+
+    const size_t size = 4'000'000;
+    UnorderedMap<uint64_t, uint64_t> map;
+    map.reserve(size);
+    std::mt19937_64 gen(21);
+    std::vector<uint64_t> keys(size);
+    for (uint64_t& key : keys) {
+        key = gen();
+        map[key] = key;
+    }
+    // half of the probes miss
+    for (size_t i = 0; i < size; i += 2) {
+        keys[i] = gen();
+    }
+    std::shuffle(keys.begin(), keys.end(), gen);
+
+    auto start = steady_clock::now();
+    uint64_t single = 0;
+    for (uint64_t key : keys) {
+        auto it = map.find(key);
+        single += (it == map.end() ? 0 : it->second);
+    }
+    duration<double, std::milli> single_time = steady_clock::now() - start;
+
+    start = steady_clock::now();
+    uint64_t batched = 0;
+    std::vector<UnorderedMap<uint64_t, uint64_t>::iterator> found(1024);
+    for (size_t base = 0; base < keys.size(); base += found.size()) {
+        auto batch = std::span(keys).subspan(base, std::min(found.size(), keys.size() - base));
+        map.find_many(batch, found);
+        for (size_t i = 0; i < batch.size(); ++i) {
+            batched += (found[i] == map.end() ? 0 : found[i]->second);
+        }
+    }
+    duration<double, std::milli> batched_time = steady_clock::now() - start;
+
+    // timings only, the speedup is not checked
+    std::cerr << " 4M lookups in a 4M-element map: find " << single_time.count() << " ms, find_many "
+            << batched_time.count() << " ms, speedup " << single_time / batched_time << "x" << std::endl;
+
+    assert(single == batched);
+}
+
+struct CountingHash {
+    static size_t calls;
+
+    size_t operator()(const std::string& key) const {
+        ++calls;
+        return std::hash<std::string>()(key);
+    }
+};
+
+size_t CountingHash::calls = 0;
+
+struct CountingEqual {
+    static size_t calls;
+
+    bool operator()(const std::string& first, const std::string& second) const {
+        ++calls;
+        return first == second;
+    }
+};
+
+size_t CountingEqual::calls = 0;
+
+template <>
+struct CacheHash<long long> : std::true_type {};
+
+void TestHashCaching() {
+    static_assert(CacheHash<std::string>::value && !CacheHash<int>::value && !CacheHash<const char*>::value);
+
+    UnorderedMap<std::string, int, CountingHash, CountingEqual> map;
+    map.max_load_factor(8.0F);
+    CountingHash::calls = 0;
+    for (int i = 0; i < 10'000; ++i) {
+        map["key " + std::to_string(i)] = i;
+    }
+    assert(CountingHash::calls == 10'000);
+    map.rehash(1 << 16);
+    map.max_load_factor(1.0F);
+    map.rehash(0);
+    assert(CountingHash::calls == 10'000);
+
+    // keys are compared only when the stored hash matches
+    CountingEqual::calls = 0;
+    map.max_load_factor(8.0F);
+    for (int i = 0; i < 10'000; ++i) {
+        assert(map.at("key " + std::to_string(i)) == i && !map.contains("none " + std::to_string(i)));
+    }
+    assert(CountingEqual::calls == 10'000);
+
+    CountingHash::calls = 0;
+    for (auto it = map.begin(); it != map.end();) {
+        it = (it->second % 2 == 0 ? map.erase(it) : std::next(it));
+    }
+    assert(CountingHash::calls == 0 && map.size() == 5'000 && map.at("key 1") == 1);
+
+    UnorderedMap<std::string, int, CountingHash, CountingEqual> incremental;
+    incremental.incremental_rehash(true);
+    CountingHash::calls = 0;
+    for (int i = 0; i < 10'000; ++i) {
+        incremental["key " + std::to_string(i)] = i;
+    }
+    assert(CountingHash::calls == 10'000 && incremental.at("key 9999") == 9'999);
+
+    // a shard and its map share one hash of the key
+    ConcurrentUnorderedMap<std::string, int, CountingHash, CountingEqual> sharded(4);
+    CountingHash::calls = 0;
+    for (int i = 0; i < 1'000; ++i) {
+        sharded.insert_or_assign("key " + std::to_string(i), i);
+    }
+    assert(CountingHash::calls == 1'000);
+    assert(sharded.find("key 7") == 7 && sharded.contains("key 8") && !sharded.contains("none"));
+    assert(sharded.visit("key 9", [](int& value) { value = -9; }) && sharded.erase("key 9") == 1);
+    assert(CountingHash::calls == 1'005);
+
+    // an integer key type can opt in
+    UnorderedMap<long long, int> cached;
+    cached.incremental_rehash(true);
+    CompareWithStd(200'000, 50'000, std::move(cached));
+}
+
+void TestNodeHandles() {
+    using Map = UnorderedMap<std::string, std::string>;
+    auto long_string = [](int i) { return std::string(32, 'a') + std::to_string(i); };
+    Map source;
+    Map target;
+    for (int i = 0; i < 1'000; ++i) {
+        source[long_string(i)] = long_string(-i);
+    }
+    for (int i = 500; i < 1'500; ++i) {
+        target[long_string(i)] = "target";
+    }
+    target.reserve(2'000);
+
+    // nothing is allocated or copied on the way between maps
+    const std::string one = long_string(1);
+    const std::string minus_one = long_string(-1);
+    const std::string six_hundred = long_string(600);
+    const std::string* address = &source.at(one);
+    size_t before = new_calls;
+    auto node = source.extract(one);
+    assert(node && node.key() == one && node.mapped() == minus_one);
+    assert(!source.contains(one) && source.size() == 999 && node.get_allocator() == source.get_allocator());
+    auto [position, inserted, rest] = target.insert(std::move(node));
+    assert(inserted && rest.empty() && node.empty() && &position->second == address);
+    assert(target.at(one) == minus_one);
+
+    node = source.extract(source.find(six_hundred));
+    auto taken = target.insert(std::move(node));
+    assert(!taken.inserted && taken.node.key() == six_hundred && taken.position->second == "target");
+    assert(target.insert(target.end(), Map::node_type()) == target.end());
+    assert(!source.extract(one) && !target.insert(Map::node_type()).inserted);
+    assert(new_calls == before);
+
+    // the key can change on the way
+    taken.node.key() = long_string(5'000);
+    auto moved = target.insert(target.begin(), std::move(taken.node));
+    assert(moved->first == long_string(5'000) && target.find(long_string(5'000)) == moved);
+
+    before = new_calls;
+    target.merge(source);
+    assert(new_calls == before);
+    assert(target.size() == 1'501 && source.size() == 499);
+    for (const auto& [key, value]: source) {
+        assert(target.at(key) == "target");
+    }
+    assert(target.at(long_string(0)) == long_string(0) && target.at(long_string(499)) == long_string(-499));
+    target.merge(std::move(source));
+    assert(source.size() == 499);
+
+    // a migrating map hands over nodes from both of its tables
+    UnorderedMap<int, int> from;
+    from.incremental_rehash(true);
+    UnorderedMap<int, int> to;
+    to.incremental_rehash(true);
+    for (int i = 0; i < 5'000 || !from.migrating(); ++i) {
+        from[i] = i;
+    }
+    for (int i = 0; i < 20'000; i += 3) {
+        to[-i] = i;
+    }
+    size_t expected = from.size() + to.size() - 1;
+    to.merge(from);
+    assert(from.size() == 1 && from.at(0) == 0 && to.size() == expected && to.at(-3) == 3 && to.at(4'000) == 4'000);
+    for (int i = 1; i < 100; ++i) {
+        from.insert(to.extract(i));
+    }
+    assert(from.size() == 100 && from.at(99) == 99 && !to.contains(99));
+
+    // a node of another arena is moved into a new one
+    using Alloc = StackAllocator<std::pair<const int, Accountant>, 1'000'000>;
+    using ArenaMap = UnorderedMap<int, Accountant, std::hash<int>, std::equal_to<int>, Alloc>;
+    auto first_storage = std::unique_ptr<StackStorage<1'000'000>>(new StackStorage<1'000'000>);
+    auto second_storage = std::unique_ptr<StackStorage<1'000'000>>(new StackStorage<1'000'000>);
+    Accountant::alive = 0;
+    {
+        ArenaMap first{Alloc(*first_storage)};
+        ArenaMap second{Alloc(*second_storage)};
+        for (int i = 0; i < 100; ++i) {
+            first.try_emplace(i, i);
+        }
+        second.insert(first.extract(7));
+        second.merge(first);
+        assert(first.empty() && second.size() == 100 && second.at(7).value == 7 && Accountant::alive == 100);
+        auto dropped = second.extract(8);
+        assert(Accountant::alive == 100);
+    }
+    assert(Accountant::alive == 0);
+}
+
+template <typename Map>
+int MapPerformanceTest(Map map) {
+    std::mt19937_64 gen(17);
+    auto start = std::chrono::high_resolution_clock::now();
+    {
+        Map moved = std::move(map);
+        for (int i = 0; i < 1'000'000; ++i) {
+            moved[gen() % 2'000'000] = i;
+        }
+        uint64_t found = 0;
+        for (int i = 0; i < 1'000'000; ++i) {
+            found += moved.count(gen() % 2'000'000);
+        }
+        for (int i = 0; i < 500'000; ++i) {
+            moved.erase(gen() % 2'000'000);
+        }
+        for (int i = 0; i < 500'000; ++i) {
+            moved.emplace(gen() % 2'000'000, i);
+        }
+        assert(found > 0);
+    }
+    auto finish = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration_cast<std::chrono::milliseconds>(finish - start).count();
+}
+
+constexpr size_t MAP_STORAGE_SIZE = 150'000'000;
+
+template <template <typename, typename, typename, typename, typename> class Map>
+void TestMapPerformance() {
+    using Storage = StackStorage<MAP_STORAGE_SIZE>;
+    using Alloc = StackAllocator<std::pair<const uint64_t, int>, MAP_STORAGE_SIZE>;
+    using StdMap = Map<uint64_t, int, std::hash<uint64_t>, std::equal_to<uint64_t>,
+            std::allocator<std::pair<const uint64_t, int>>>;
+    using StackMap = Map<uint64_t, int, std::hash<uint64_t>, std::equal_to<uint64_t>, Alloc>;
+
+    std::ostringstream oss_first;
+    std::ostringstream oss_second;
+
+    double mean_first = 0.0;
+    double mean_second = 0.0;
+
+    for (int i = 0; i < 3; ++i) {
+        int first = MapPerformanceTest(StdMap());
+        mean_first += first;
+        oss_first << first << " ";
+
+        auto storage = std::unique_ptr<Storage>(new Storage);
+        int second = MapPerformanceTest(StackMap(Alloc(*storage)));
+        mean_second += second;
+        oss_second << second << " ";
+    }
+
+    mean_first /= 3;
+    mean_second /= 3;
+
+    std::cerr << " Results with std::allocator: " << oss_first.str()
+            << " ms, results with StackAllocator: " << oss_second.str() << " ms " << std::endl;
+
+    if (mean_first < mean_second) {
+        throw std::runtime_error("StackAllocator expected to be faster than std::allocator, but mean time were "
+                + std::to_string(mean_second) + " ms comparing with " + std::to_string(mean_first) + " ms");
+    }
+}
+
+int main() {
+    TestBasics<FlatUnorderedMap>();
+
+    std::cerr << "Test 1 (FlatUnorderedMap basics) passed." << std::endl;
+
+    TestFlatGrowthAndErase();
+
+    std::cerr << "Test 2 (FlatUnorderedMap growth and erase) passed." << std::endl;
+
+    TestCopyMoveAndAllocator<FlatUnorderedMap>();
+
+    std::cerr << "Test 3 (FlatUnorderedMap copy, move and allocator) passed." << std::endl;
+
+    TestBasics<UnorderedMap>();
+    TestCopyMoveAndAllocator<UnorderedMap>();
+
+    std::cerr << "Test 4 (UnorderedMap basics, copy, move and allocator) passed." << std::endl;
+
+    TestNodeStabilityAndArena();
+
+    std::cerr << "Test 5 (UnorderedMap stability and arena) passed." << std::endl;
+
+    TestHeterogeneousLookup();
+
+    std::cerr << "Test 6 (UnorderedMap heterogeneous lookup) passed." << std::endl;
+
+    TestIncrementalRehash();
+
+    std::cerr << "Test 7 (UnorderedMap incremental rehash) passed." << std::endl;
+
+    TestConcurrentUnorderedMap();
+
+    std::cerr << "Test 8 (ConcurrentUnorderedMap) passed." << std::endl;
+
+    TestFindMany();
+
+    std::cerr << "Test 9 (UnorderedMap batched lookup) passed." << std::endl;
+
+    TestHashCaching();
+
+    std::cerr << "Test 10 (UnorderedMap hash caching) passed." << std::endl;
+
+    TestNodeHandles();
+
+    std::cerr << "Test 11 (UnorderedMap node handles) passed." << std::endl;
+
+    CompareFlatPerformance();
+    CompareBatchedLookup();
+
+    std::cerr << "Allocators with std::unordered_map:" << std::endl;
+
+    TestMapPerformance<std::unordered_map>();
+
+    std::cerr << "Allocators with UnorderedMap:" << std::endl;
+
+    TestMapPerformance<UnorderedMap>();
+
+    std::cerr << "Tests passed!" << std::endl;
+
+    std::cout << 0;
+}
+
+// NOLINTEND
+
+#else
+
+int main() {
+    std::cerr << "Tests are turned off!\n";
+}
+
+#endif